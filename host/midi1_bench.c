@@ -0,0 +1,821 @@
+/**
+ * @file midi1_bench.c
+ * @brief Host benchmark of the protocol only code.
+ *
+ * @note
+ * Streams MIDI corpora through midi1_parser.c, the parser it replaced
+ * (midi1_parser_ref.c), midi1_controller.c and, when built with
+ * ZEPHYR_BASE, the midi1_* UMP encoders, and runs the
+ * tempo math of midi1_tempo.c, midi1_clock_dds.c and midi1_clock_ramp.c.
+ * Every bench prints what it processed, a checksum of everything that
+ * came out, ns and cycles per byte (per period for the tempo math) and
+ * messages per second.
+ *
+ *   midi1_bench                        print the table
+ *   midi1_bench --write FILE           also write it as a new baseline
+ *   midi1_bench --check FILE           compare with a baseline, the
+ *                                      checksums must match
+ *   midi1_bench --max-slowdown PCT     with --check: slower than PCT %
+ *                                      against the baseline also fails
+ *   midi1_bench FILE ...               add raw MIDI byte streams, e.g.
+ *                                      a capture of a DIN port
+ *
+ * The built in corpora are synthetic, made with a fixed seed so the
+ * checksums are the same on every host.  "mixed" is a performance like
+ * stream with every message type, running status, realtime bytes in
+ * the middle of messages and the odd broken message.  The timing is of
+ * the host, compare it with a baseline of the same machine.  Cycles are
+ * the time stamp counter on x86, elsewhere only ns are shown.
+ *
+ * Before the benches every corpus goes through both parsers once and
+ * the events must be identical, else the run fails.  Only what the old
+ * parser reported is compared: note on/off, control change, pitch wheel
+ * and realtime, channel messages without their channel.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#include "midi1_defs.h"
+#include "midi1_tempo.h"
+#include "midi1_parser.h"
+#include "midi1_parser_ref.h"
+#include "midi1_controller.h"
+#include "midi1_clock_dds.h"
+#include "midi1_clock_ramp.h"
+#if MIDI1_HOST_UMP
+#include "midi1.h"
+#endif
+
+#define BENCH_CORPUS_SIZE 16384
+/* Bytes parsed per parser bench, the corpus is repeated */
+#define BENCH_BYTES (4UL << 20)
+/* Periods per tempo bench */
+#define BENCH_PERIODS 1000000UL
+/* Every bench runs this often, the fastest run counts */
+#define BENCH_REPEAT 3
+#define BENCH_MAX 32
+#define BENCH_FILE_MAX (1UL << 20)
+#define BENCH_CLOCK_HZ 48000000UL
+
+struct bench_result {
+	char name[48];
+	uint64_t items;		/* bytes, or periods for the tempo math */
+	uint64_t msgs;
+	uint32_t checksum;
+	double ns;		/* per item */
+	double cycles;		/* per item, 0 without a cycle counter */
+};
+
+struct bench_corpus {
+	char name[40];
+	uint8_t *data;
+	size_t len;
+};
+
+static struct bench_result results[BENCH_MAX];
+static unsigned int num_results;
+
+/* What the callbacks add up, per run */
+static uint32_t sum;
+static uint64_t msgs;
+
+static inline void bench_sum(uint32_t v)
+{
+	/* FNV-1a on words, cheap enough not to hide the parser */
+	sum = (sum ^ v) * 16777619U;
+}
+
+static uint64_t bench_now_ns(void)
+{
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ULL + ts.tv_nsec;
+}
+
+static uint64_t bench_cycles(void)
+{
+#if defined(__x86_64__) || defined(__i386__)
+	return __builtin_ia32_rdtsc();
+#else
+	return 0;
+#endif
+}
+
+/*
+ * Run a bench BENCH_REPEAT times, keep the fastest.  The bench sets
+ * items, the callbacks set msgs and the checksum.
+ */
+static void bench_run(const char *name, uint64_t (*fn)(const void *arg),
+		      const void *arg)
+{
+	struct bench_result *r = &results[num_results];
+	uint64_t best_ns = UINT64_MAX;
+	uint64_t best_cycles = 0;
+
+	if (num_results == BENCH_MAX) {
+		fprintf(stderr, "too many benches, %s left out\n", name);
+		return;
+	}
+	snprintf(r->name, sizeof(r->name), "%s", name);
+	for (int i = 0; i < BENCH_REPEAT; i++) {
+		uint64_t ns, cycles;
+
+		sum = 2166136261U;
+		msgs = 0;
+		ns = bench_now_ns();
+		cycles = bench_cycles();
+		r->items = fn(arg);
+		cycles = bench_cycles() - cycles;
+		ns = bench_now_ns() - ns;
+		if (ns < best_ns) {
+			best_ns = ns;
+			best_cycles = cycles;
+		}
+	}
+	r->msgs = msgs;
+	r->checksum = sum;
+	r->ns = (double)best_ns / r->items;
+	r->cycles = (double)best_cycles / r->items;
+	num_results++;
+}
+
+/* -- Corpora -- */
+static uint32_t rnd_state;
+
+static uint32_t rnd(uint32_t n)
+{
+	rnd_state = rnd_state * 1664525U + 1013904223U;
+	return (rnd_state >> 8) % n;
+}
+
+static struct bench_corpus corpus_new(const char *name)
+{
+	struct bench_corpus c;
+
+	snprintf(c.name, sizeof(c.name), "%s", name);
+	c.data = malloc(BENCH_CORPUS_SIZE);
+	c.len = 0;
+	if (c.data == NULL) {
+		perror("malloc");
+		exit(2);
+	}
+	return c;
+}
+
+static inline void put(struct bench_corpus *c, uint8_t b)
+{
+	c->data[c->len++] = b;
+}
+
+/* Chords on a few channels in running status, note off as velocity 0 */
+static struct bench_corpus corpus_notes(void)
+{
+	struct bench_corpus c = corpus_new("notes");
+	uint8_t ch = 0;
+	uint32_t n = 0;
+
+	rnd_state = 1;
+	while (c.len + 32 < BENCH_CORPUS_SIZE) {
+		if ((n % 64) == 0) {
+			ch = rnd(4);
+			put(&c, C_NOTE_ON | ch);
+		}
+		for (int i = 0; i < 4; i++) {
+			put(&c, 48 + rnd(36));
+			put(&c, 1 + rnd(126));
+		}
+		for (int i = 0; i < 4; i++) {
+			put(&c, 48 + rnd(36));
+			put(&c, 0);
+		}
+		if ((n % 4) == 0) {
+			put(&c, RT_TIMING_CLOCK);
+		}
+		n++;
+	}
+	return c;
+}
+
+/*
+ * Controller sweeps in running status, 14 bit pairs, RPN data entry,
+ * pitch wheel and aftertouch, clocks between the messages.
+ */
+static struct bench_corpus corpus_controllers(void)
+{
+	struct bench_corpus c = corpus_new("controllers");
+	uint32_t n = 0;
+
+	rnd_state = 2;
+	while (c.len + 64 < BENCH_CORPUS_SIZE) {
+		uint8_t ch = rnd(16);
+
+		put(&c, C_CONTROL_CHANGE | ch);
+		for (int i = 0; i < 8; i++) {
+			put(&c, CTL_MSB_MODWHEEL);
+			put(&c, rnd(128));
+		}
+		put(&c, CTL_MSB_MAIN_VOLUME);
+		put(&c, rnd(128));
+		put(&c, CTL_LSB_MAIN_VOLUME);
+		put(&c, rnd(128));
+		put(&c, CTL_RPN_MSB);
+		put(&c, 0);
+		put(&c, CTL_RPN_LSB);
+		put(&c, rnd(3));
+		put(&c, CTL_MSB_DATA_ENTRY);
+		put(&c, rnd(128));
+		put(&c, CTL_LSB_DATA_ENTRY);
+		put(&c, rnd(128));
+		put(&c, RT_TIMING_CLOCK);
+		put(&c, C_PITCH_WHEEL | ch);
+		for (int i = 0; i < 4; i++) {
+			put(&c, rnd(128));
+			put(&c, rnd(128));
+		}
+		put(&c, C_CHANNEL_AFTERTOUCH | ch);
+		put(&c, rnd(128));
+		put(&c, rnd(128));
+		if ((n++ % 2) == 0) {
+			put(&c, RT_TIMING_CLOCK);
+		}
+	}
+	return c;
+}
+
+/* Dumps of a few hundred bytes with clocks in the middle */
+static struct bench_corpus corpus_sysex(void)
+{
+	struct bench_corpus c = corpus_new("sysex");
+
+	rnd_state = 3;
+	while (c.len + 400 < BENCH_CORPUS_SIZE) {
+		uint32_t n = 64 + rnd(300);
+
+		put(&c, SYSTEM_EXCLUSIVE_START);
+		for (uint32_t i = 0; i < n; i++) {
+			if ((i % 50) == 49) {
+				put(&c, RT_TIMING_CLOCK);
+			}
+			put(&c, rnd(128));
+		}
+		put(&c, SYSTEM_EXCLUSIVE_END);
+	}
+	return c;
+}
+
+/* Any channel message, in running status or not */
+static void mixed_channel(struct bench_corpus *c, uint8_t *running)
+{
+	static const uint8_t types[] = {
+		C_NOTE_OFF, C_NOTE_ON, C_NOTE_ON, C_NOTE_ON,
+		C_POLYPHONIC_AFTERTOUCH, C_CONTROL_CHANGE, C_CONTROL_CHANGE,
+		C_PROGRAM_CHANGE, C_CHANNEL_AFTERTOUCH, C_PITCH_WHEEL,
+	};
+	uint8_t status = types[rnd(sizeof(types))] | rnd(16);
+	uint8_t len = midi1_msg_len(status);
+
+	if (status != *running || rnd(8) == 0) {
+		put(c, status);
+	}
+	*running = status;
+	for (uint8_t i = 0; i < len; i++) {
+		if (rnd(16) == 0) {
+			/* Realtime between the bytes of a message */
+			put(c, RT_TIMING_CLOCK + rnd(8));
+		}
+		if (rnd(128) == 0 && i + 1 < len) {
+			/* Cut short, the next status is an error */
+			return;
+		}
+		put(c, rnd(128));
+	}
+}
+
+static struct bench_corpus corpus_mixed(void)
+{
+	struct bench_corpus c = corpus_new("mixed");
+	uint8_t running = 0;
+
+	rnd_state = 4;
+	while (c.len + 64 < BENCH_CORPUS_SIZE) {
+		uint32_t kind = rnd(100);
+
+		if (kind < 80) {
+			mixed_channel(&c, &running);
+			continue;
+		}
+		if (kind < 88) {
+			put(&c, RT_TIMING_CLOCK);
+			continue;
+		}
+		/* Everything below cancels the running status */
+		running = 0;
+		switch (kind) {
+		case 88:
+			put(&c, SYSTEM_SONG_POSITION);
+			put(&c, rnd(128));
+			put(&c, rnd(128));
+			break;
+		case 89:
+			put(&c, SYSTEM_SONG_SELECT);
+			put(&c, rnd(128));
+			break;
+		case 90:
+			put(&c, SYSTEM_MTC_QUARTER_FRAME);
+			put(&c, rnd(128));
+			break;
+		case 91:
+			put(&c, SYSTEM_TUNE_REQUEST);
+			break;
+		case 92:
+			/* Undefined status */
+			put(&c, 0xF4 + rnd(2));
+			break;
+		case 93:
+			/* Data without status */
+			put(&c, rnd(128));
+			break;
+		case 94:
+		case 95: {
+			uint32_t n = rnd(40);
+
+			put(&c, SYSTEM_EXCLUSIVE_START);
+			for (uint32_t i = 0; i < n; i++) {
+				put(&c, rnd(128));
+			}
+			/* Sometimes ended by another status byte */
+			if (rnd(4) != 0) {
+				put(&c, SYSTEM_EXCLUSIVE_END);
+			}
+			break;
+		}
+		default:
+			put(&c, RT_START + rnd(3));
+			break;
+		}
+	}
+	return c;
+}
+
+static bool corpus_file(const char *path, struct bench_corpus *c)
+{
+	const char *base = strrchr(path, '/');
+	FILE *f = fopen(path, "rb");
+
+	if (f == NULL) {
+		perror(path);
+		return false;
+	}
+	snprintf(c->name, sizeof(c->name), "file:%.32s",
+		 base != NULL ? base + 1 : path);
+	c->data = malloc(BENCH_FILE_MAX);
+	if (c->data == NULL) {
+		fclose(f);
+		return false;
+	}
+	c->len = fread(c->data, 1, BENCH_FILE_MAX, f);
+	fclose(f);
+	return c->len > 0;
+}
+
+/* -- Parser -- */
+static void on_message(void *ctx, const struct midi1_msg *msg)
+{
+	bench_sum(msg->type | (msg->status << 8) | (msg->data1 << 16) |
+		  ((uint32_t)msg->data2 << 24));
+	msgs++;
+}
+
+static void on_sysex_start(void *ctx)
+{
+	bench_sum(SYSTEM_EXCLUSIVE_START);
+}
+
+static void on_sysex_byte(void *ctx, uint8_t c)
+{
+	bench_sum(c);
+}
+
+static void on_sysex_end(void *ctx, bool aborted)
+{
+	bench_sum(aborted ? 0x100 | SYSTEM_EXCLUSIVE_END :
+		  SYSTEM_EXCLUSIVE_END);
+	msgs++;
+}
+
+static const struct midi1_parser_ops parser_ops = {
+	.message = on_message,
+	.sysex_start = on_sysex_start,
+	.sysex_byte = on_sysex_byte,
+	.sysex_end = on_sysex_end,
+};
+
+static uint64_t bench_parse(const struct bench_corpus *c,
+			    const struct midi1_parser_ops *ops, void *ctx)
+{
+	struct midi1_parser ps;
+	uint64_t bytes = 0;
+
+	midi1_parser_init(&ps, ops, ctx);
+	while (bytes < BENCH_BYTES) {
+		midi1_parser_bytes(&ps, c->data, c->len);
+		bytes += c->len;
+	}
+	bench_sum(ps.errors);
+	return bytes;
+}
+
+static uint64_t bench_parser(const void *arg)
+{
+	return bench_parse(arg, &parser_ops, NULL);
+}
+
+/* -- The parser before midi1_parser.c -- */
+static uint64_t bench_parser_ref(const void *arg)
+{
+	const struct bench_corpus *c = arg;
+	struct midi1_parser_ref ps;
+	uint64_t bytes = 0;
+
+	midi1_parser_ref_init(&ps, &parser_ops, NULL);
+	while (bytes < BENCH_BYTES) {
+		midi1_parser_ref_bytes(&ps, c->data, c->len);
+		bytes += c->len;
+	}
+	return bytes;
+}
+
+/* -- Old and new parser give the same events -- */
+struct equiv_events {
+	uint32_t *ev;
+	size_t num;
+	size_t max;
+};
+
+static void on_message_equiv(void *ctx, const struct midi1_msg *msg)
+{
+	struct equiv_events *e = ctx;
+	uint8_t status = msg->status;
+
+	switch (msg->type) {
+	case MIDI1_MSG_NOTE_OFF:
+	case MIDI1_MSG_NOTE_ON:
+	case MIDI1_MSG_CONTROL_CHANGE:
+	case MIDI1_MSG_PITCH_WHEEL:
+		/* The old parser was OMNI and cleared the channel */
+		status &= ~CHANNEL_MASK;
+		break;
+	case MIDI1_MSG_REALTIME:
+		break;
+	default:
+		/* Never reported by the old parser */
+		return;
+	}
+	if (e->num == e->max) {
+		e->max = e->max != 0 ? 2 * e->max : 4096;
+		e->ev = realloc(e->ev, e->max * sizeof(e->ev[0]));
+		if (e->ev == NULL) {
+			perror("realloc");
+			exit(2);
+		}
+	}
+	e->ev[e->num++] = msg->type | (status << 8) | (msg->data1 << 16) |
+			  ((uint32_t)msg->data2 << 24);
+}
+
+static const struct midi1_parser_ops equiv_ops = {
+	.message = on_message_equiv,
+};
+
+static bool equiv_check(const struct bench_corpus *c)
+{
+	struct equiv_events new_ev = { 0 };
+	struct equiv_events ref_ev = { 0 };
+	struct midi1_parser ps;
+	struct midi1_parser_ref ref;
+	size_t i;
+	bool same;
+
+	midi1_parser_init(&ps, &equiv_ops, &new_ev);
+	midi1_parser_bytes(&ps, c->data, c->len);
+	midi1_parser_ref_init(&ref, &equiv_ops, &ref_ev);
+	midi1_parser_ref_bytes(&ref, c->data, c->len);
+
+	for (i = 0; i < new_ev.num && i < ref_ev.num; i++) {
+		if (new_ev.ev[i] != ref_ev.ev[i]) {
+			break;
+		}
+	}
+	same = i == new_ev.num && i == ref_ev.num;
+	if (same) {
+		printf("%-28s %10zu events same\n", c->name, i);
+	} else {
+		printf("%-28s event %zu DIFFERENT: new 0x%08x old 0x%08x\n",
+		       c->name, i, i < new_ev.num ? new_ev.ev[i] : 0,
+		       i < ref_ev.num ? ref_ev.ev[i] : 0);
+	}
+	free(new_ev.ev);
+	free(ref_ev.ev);
+	return same;
+}
+
+/* -- Parser and 14 bit controller assembly -- */
+static void on_message_assemble(void *ctx, const struct midi1_msg *msg)
+{
+	struct midi1_msg out;
+
+	on_message(ctx, msg);
+	if (msg->type == MIDI1_MSG_CONTROL_CHANGE &&
+	    midi1_controller_assemble(ctx, msg, &out)) {
+		bench_sum(out.type | ((uint32_t)out.param << 8));
+		bench_sum(out.value);
+		msgs++;
+	}
+}
+
+static const struct midi1_parser_ops controller_ops = {
+	.message = on_message_assemble,
+};
+
+static uint64_t bench_controller(const void *arg)
+{
+	static struct midi1_controller_state cs;
+
+	midi1_controller_init(&cs);
+	return bench_parse(arg, &controller_ops, &cs);
+}
+
+#if MIDI1_HOST_UMP
+/* -- Parser and UMP encoders, what the DIN to USB bridge does -- */
+static void on_message_ump(void *ctx, const struct midi1_msg *msg)
+{
+	const uint8_t ch = msg->status & CHANNEL_MASK;
+	struct midi_ump ump;
+
+	switch (msg->status & ~CHANNEL_MASK) {
+	case C_NOTE_OFF:
+		ump = midi1_note_off(ch, msg->data1, msg->data2);
+		break;
+	case C_NOTE_ON:
+		ump = midi1_note_on(ch, msg->data1, msg->data2);
+		break;
+	case C_POLYPHONIC_AFTERTOUCH:
+		ump = midi1_polyaftertouch(ch, msg->data1, msg->data2);
+		break;
+	case C_CONTROL_CHANGE:
+		ump = midi1_controlchange(ch, msg->data1, msg->data2);
+		break;
+	case C_PROGRAM_CHANGE:
+		ump = midi1_programchange(ch, msg->data1);
+		break;
+	case C_CHANNEL_AFTERTOUCH:
+		ump = midi1_channelaftertouch(ch, msg->data1);
+		break;
+	case C_PITCH_WHEEL:
+		ump = midi1_pitchwheel(ch, msg->data1 | (msg->data2 << 7));
+		break;
+	default:
+		ump = midi1_system_message(msg->status, msg->data1,
+					   msg->data2);
+		break;
+	}
+	bench_sum(ump.data[0]);
+	msgs++;
+}
+
+static const struct midi1_parser_ops ump_ops = {
+	.message = on_message_ump,
+};
+
+static uint64_t bench_ump(const void *arg)
+{
+	return bench_parse(arg, &ump_ops, NULL);
+}
+#endif
+
+/* -- Tempo math -- */
+static uint64_t bench_sbpm_to_ticks(const void *arg)
+{
+	uint64_t n = 0;
+
+	while (n < BENCH_PERIODS) {
+		for (uint32_t sbpm = 1; sbpm <= UINT16_MAX; sbpm++) {
+			bench_sum(sbpm_to_ticks(sbpm, BENCH_CLOCK_HZ));
+		}
+		n += UINT16_MAX;
+	}
+	msgs = n;
+	return n;
+}
+
+static uint64_t bench_dds(const void *arg)
+{
+	struct midi1_clock_dds dds;
+
+	midi1_clock_dds_init(&dds, 12345, BENCH_CLOCK_HZ,
+			     MIDI1_CLOCK_DDS_PPQN);
+	for (uint64_t n = 0; n < BENCH_PERIODS; n++) {
+		bench_sum(midi1_clock_dds_next(&dds));
+	}
+	msgs = BENCH_PERIODS;
+	return BENCH_PERIODS;
+}
+
+/*
+ * Ramps between 60 and 180 BPM over 64 beats of 96 PPQN, up and down.
+ * The start of a ramp is in the time as well, it is only paid once per
+ * 6144 periods.
+ */
+static uint64_t bench_ramp(const void *arg)
+{
+	const uint8_t curve = *(const uint8_t *)arg;
+	struct midi1_clock_ramp ramp;
+	/* 60 BPM */
+	uint32_t period = BENCH_CLOCK_HZ / 96;
+	uint64_t n = 0;
+	bool up = true;
+
+	while (n < BENCH_PERIODS) {
+		midi1_clock_ramp_start(&ramp, period, up ? 18000 : 6000,
+				       64 * 96, curve, BENCH_CLOCK_HZ, 96);
+		while (midi1_clock_ramp_active(&ramp)) {
+			bench_sum(midi1_clock_ramp_next(&ramp));
+			n++;
+		}
+		period = ramp.period;
+		up = !up;
+	}
+	msgs = n;
+	return n;
+}
+
+/* -- Baseline -- */
+static void print_results(FILE *f)
+{
+	fprintf(f, "# %-26s %10s %10s %10s %8s %8s\n", "bench", "items",
+		"msgs", "checksum", "ns/item", "cyc/item");
+	for (unsigned int i = 0; i < num_results; i++) {
+		const struct bench_result *r = &results[i];
+
+		fprintf(f, "%-28s %10llu %10llu 0x%08x %8.3f %8.3f\n",
+			r->name, (unsigned long long)r->items,
+			(unsigned long long)r->msgs, r->checksum, r->ns,
+			r->cycles);
+	}
+}
+
+static struct bench_result *find_result(const char *name)
+{
+	for (unsigned int i = 0; i < num_results; i++) {
+		if (strcmp(results[i].name, name) == 0) {
+			return &results[i];
+		}
+	}
+	return NULL;
+}
+
+/*
+ * Compare with a baseline written by --write.  Different output is a
+ * failure, a bench that did not run (no UMP encoders) is skipped.
+ */
+static int check_baseline(const char *path, double max_slowdown)
+{
+	char line[256];
+	int failed = 0;
+	FILE *f = fopen(path, "r");
+
+	if (f == NULL) {
+		perror(path);
+		return 1;
+	}
+	printf("\n%-28s %8s  %s\n", "against baseline", "time", "output");
+	while (fgets(line, sizeof(line), f) != NULL) {
+		struct bench_result base;
+		unsigned long long items, n;
+		const struct bench_result *r;
+		double pct;
+		bool same;
+
+		if (line[0] == '#' ||
+		    sscanf(line, "%47s %llu %llu %x %lf %lf", base.name, &items,
+			   &n, &base.checksum, &base.ns, &base.cycles) != 6) {
+			continue;
+		}
+		r = find_result(base.name);
+		if (r == NULL) {
+			printf("%-28s %8s  skipped\n", base.name, "-");
+			continue;
+		}
+		same = r->items == items && r->msgs == n &&
+		       r->checksum == base.checksum;
+		pct = base.ns > 0 ? 100.0 * r->ns / base.ns : 100.0;
+		printf("%-28s %7.0f%%  %s\n", r->name, pct,
+		       same ? "same" : "DIFFERENT");
+		if (!same || (max_slowdown > 0 && pct > 100.0 + max_slowdown)) {
+			failed = 1;
+		}
+	}
+	fclose(f);
+	return failed;
+}
+
+int main(int argc, char **argv)
+{
+	static const uint8_t linear = MIDI1_CLOCK_RAMP_LINEAR;
+	static const uint8_t exponential = MIDI1_CLOCK_RAMP_EXPONENTIAL;
+	struct bench_corpus corpora[8];
+	unsigned int num_corpora = 0;
+	const char *write_path = NULL;
+	const char *check_path = NULL;
+	double max_slowdown = 0;
+	char name[sizeof(results[0].name)];
+	int failed = 0;
+
+	corpora[num_corpora++] = corpus_notes();
+	corpora[num_corpora++] = corpus_controllers();
+	corpora[num_corpora++] = corpus_sysex();
+	corpora[num_corpora++] = corpus_mixed();
+	for (int i = 1; i < argc; i++) {
+		if (strcmp(argv[i], "--write") == 0 && i + 1 < argc) {
+			write_path = argv[++i];
+		} else if (strcmp(argv[i], "--check") == 0 && i + 1 < argc) {
+			check_path = argv[++i];
+		} else if (strcmp(argv[i], "--max-slowdown") == 0 &&
+			   i + 1 < argc) {
+			max_slowdown = atof(argv[++i]);
+		} else if (argv[i][0] == '-') {
+			fprintf(stderr, "usage: %s [--write FILE] [--check FILE "
+				"[--max-slowdown PCT]] [MIDI FILE ...]\n",
+				argv[0]);
+			return 2;
+		} else if (num_corpora < sizeof(corpora) / sizeof(corpora[0]) &&
+			   corpus_file(argv[i], &corpora[num_corpora])) {
+			num_corpora++;
+		}
+	}
+
+	printf("%-28s old and new parser\n", "equivalence");
+	for (unsigned int i = 0; i < num_corpora; i++) {
+		if (!equiv_check(&corpora[i])) {
+			failed = 1;
+		}
+	}
+	printf("\n");
+
+	for (unsigned int i = 0; i < num_corpora; i++) {
+		snprintf(name, sizeof(name), "parser.%.40s", corpora[i].name);
+		bench_run(name, bench_parser, &corpora[i]);
+	}
+	for (unsigned int i = 0; i < num_corpora; i++) {
+		snprintf(name, sizeof(name), "parser_ref.%.36s",
+			 corpora[i].name);
+		bench_run(name, bench_parser_ref, &corpora[i]);
+	}
+	bench_run("controller.controllers", bench_controller, &corpora[1]);
+#if MIDI1_HOST_UMP
+	for (unsigned int i = 0; i < num_corpora; i++) {
+		snprintf(name, sizeof(name), "ump.%.40s", corpora[i].name);
+		bench_run(name, bench_ump, &corpora[i]);
+	}
+#endif
+	bench_run("tempo.sbpm_to_ticks", bench_sbpm_to_ticks, NULL);
+	bench_run("tempo.dds", bench_dds, NULL);
+	bench_run("tempo.ramp_linear", bench_ramp, &linear);
+	bench_run("tempo.ramp_exponential", bench_ramp, &exponential);
+
+	print_results(stdout);
+	for (unsigned int i = 0; i < num_results; i++) {
+		if (results[i].ns > 0) {
+			printf("%-28s %12.0f msgs/s\n", results[i].name,
+			       results[i].msgs * 1e9 /
+			       (results[i].ns * results[i].items));
+		}
+	}
+	if (write_path != NULL) {
+		FILE *f = fopen(write_path, "w");
+
+		if (f == NULL) {
+			perror(write_path);
+			return 1;
+		}
+		fprintf(f, "# midi1_bench baseline, see host/midi1_bench.c\n"
+			"# compiler %s\n", __VERSION__);
+		print_results(f);
+		fclose(f);
+	}
+	if (check_path != NULL && check_baseline(check_path, max_slowdown)) {
+		failed = 1;
+	}
+	return failed;
+}
+
+/* EOF */
@@ -0,0 +1,523 @@
+/**
+ * @file midi1_clock_test.c
+ * @brief Host checks of the clock generator math.
+ *
+ * @note
+ * The integer only parts of the clock generator run here against the
+ * exact values worked out in 64 bit, no board and no Zephyr needed.
+ * Every failed check prints where and why, the exit code is the number
+ * of failed tests so ctest fails on any of them.
+ *
+ *  - midi1_clock_dds.c: an hour of periods adds up to the exact time
+ *    to within a tick, the rounded period drifts as documented.
+ *  - midi1_clock_ramp.c: every clock of a ramp has the period of its
+ *    tempo on the linear or exponential curve to a few ppm, the last
+ *    one is at the target and the ramp stops there.
+ *  - midi1_clock_div.h: a fan-out output fires exactly on the master
+ *    ticks that are a multiple of its divider, also when it is added,
+ *    changed or moved to a song position later.
+ *  - midi1_clock_groove.c: every pulse of a swung beat is where the
+ *    swing puts it, the beat itself keeps its length and a table only
+ *    takes over at the start of a beat.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <errno.h>
+#include <math.h>
+
+#include "midi1_tempo.h"
+#include "midi1_clock_dds.h"
+#include "midi1_clock_ramp.h"
+#include "midi1_clock_div.h"
+#include "midi1_clock_groove.h"
+
+#define ARRAY_SIZE(a) (sizeof(a) / sizeof((a)[0]))
+
+static unsigned int checks_failed;
+
+#define CHECK(cond, ...)						\
+	do {								\
+		if (!(cond)) {						\
+			printf("%s:%d: %s: ", __FILE__, __LINE__, #cond); \
+			printf(__VA_ARGS__);				\
+			printf("\n");					\
+			checks_failed++;				\
+		}							\
+	} while (0)
+
+static const uint32_t clock_hzs[] = { 24000000, 48000000 };
+static const uint16_t tempos[] = { 12000, 12345, 9713, 3333, 17477 };
+
+/* -- midi1_clock_dds.c -- */
+
+/*
+ * One hour of periods per tempo and counter frequency.  Every period
+ * is N or N+1 and after k periods the sum is the exact k * numer / denom
+ * rounded down, so no clock is ever a tick or more off.
+ */
+static void test_dds_hour(void)
+{
+	for (size_t f = 0; f < ARRAY_SIZE(clock_hzs); f++) {
+		for (size_t i = 0; i < ARRAY_SIZE(tempos); i++) {
+			const uint32_t clock_hz = clock_hzs[f];
+			const uint16_t sbpm = tempos[i];
+			const uint64_t numer = (uint64_t)clock_hz * 60U *
+					       BPM_SCALE;
+			const uint64_t denom = (uint64_t)sbpm *
+					       MIDI1_CLOCK_DDS_PPQN;
+			const uint64_t hour = (uint64_t)clock_hz * 3600U;
+			struct midi1_clock_dds dds;
+			uint64_t t = 0;
+			uint64_t k = 0;
+			bool exact = true;
+
+			midi1_clock_dds_init(&dds, sbpm, clock_hz,
+					     MIDI1_CLOCK_DDS_PPQN);
+			CHECK(dds.ticks == numer / denom,
+			      "%u Hz %u sbpm: N %u", clock_hz, sbpm,
+			      dds.ticks);
+			while (t < hour && exact) {
+				uint32_t period = midi1_clock_dds_next(&dds);
+
+				CHECK(period == dds.ticks ||
+				      period == dds.ticks + 1,
+				      "%u Hz %u sbpm: period %u", clock_hz,
+				      sbpm, period);
+				t += period;
+				k++;
+				exact = t == k * numer / denom;
+			}
+			CHECK(exact, "%u Hz %u sbpm: clock %llu at %llu "
+			      "ticks, exact %llu", clock_hz, sbpm,
+			      (unsigned long long)k, (unsigned long long)t,
+			      (unsigned long long)(k * numer / denom));
+		}
+	}
+}
+
+/*
+ * What the accumulator is for, the figure in midi1_clock_dds.h: the
+ * rounded period at 48 MHz and 123.45 BPM is 1.7 ms late after an hour.
+ */
+static void test_dds_rounded_drift(void)
+{
+	const uint32_t clock_hz = 48000000;
+	const uint16_t sbpm = 12345;
+	const uint64_t numer = (uint64_t)clock_hz * 60U * BPM_SCALE;
+	const uint64_t denom = (uint64_t)sbpm * MIDI1_CLOCK_DDS_PPQN;
+	/* Clocks in an hour */
+	const uint64_t clocks = (uint64_t)sbpm * MIDI1_CLOCK_DDS_PPQN * 60U /
+				BPM_SCALE;
+	int64_t drift = (int64_t)(clocks * numer / denom) -
+			(int64_t)(clocks * sbpm_to_ticks(sbpm, clock_hz));
+	int64_t drift_us = drift * 1000000 / clock_hz;
+
+	CHECK(drift_us >= 1650 && drift_us < 1750, "%lld us per hour",
+	      (long long)drift_us);
+}
+
+/* A period split in div periods, e.g. 24 PPQN for a 96 PPQN master */
+static void test_dds_div(void)
+{
+	static const uint32_t periods[] = { 1, 7, 972053, 999999, 4000003 };
+
+	for (size_t i = 0; i < ARRAY_SIZE(periods); i++) {
+		for (uint8_t div = 1; div <= 8; div++) {
+			struct midi1_clock_dds dds;
+
+			midi1_clock_dds_init_div(&dds, periods[i], div);
+			for (int rep = 0; rep < 3; rep++) {
+				uint32_t sum = 0;
+
+				for (uint8_t n = 0; n < div; n++) {
+					uint32_t p = midi1_clock_dds_next(&dds);
+
+					CHECK(p == periods[i] / div ||
+					      p == periods[i] / div + 1,
+					      "%u / %u: %u", periods[i], div, p);
+					sum += p;
+				}
+				CHECK(sum == periods[i], "%u / %u: sum %u",
+				      periods[i], div, sum);
+			}
+		}
+	}
+}
+
+/* -- midi1_clock_ramp.c -- */
+
+/* The table lookups are good to a few ppm, see midi1_clock_ramp.c */
+#define RAMP_MAX_PPM 10.0
+
+struct ramp_case {
+	uint16_t from_sbpm;
+	uint16_t to_sbpm;
+	uint32_t clocks;
+	uint8_t ppqn;
+};
+
+static const struct ramp_case ramp_cases[] = {
+	{ 6000, 18000, 64 * 96, 96 },	/* the bench ramp */
+	{ 18000, 6000, 64 * 96, 96 },
+	{ 12000, 8000, 8 * 24, 24 },
+	{ 12345, 12346, 4 * 24, 24 },	/* slower than a tick per clock */
+	{ 3000, 30000, 24, 24 },
+};
+
+/*
+ * Run a ramp and compare every period with the exact one: the tempo
+ * moves by the same amount (linear) or the same ratio (exponential)
+ * every clock and the period is clock_hz * 60 / (tempo * ppqn).
+ */
+static void ramp_check(const struct ramp_case *rc, uint8_t curve)
+{
+	const uint32_t clock_hz = 48000000;
+	const double numer = (double)clock_hz * 60.0 * BPM_SCALE / rc->ppqn;
+	const uint32_t from = (uint32_t)llround(numer / rc->from_sbpm);
+	const double from_tempo = numer / from;
+	const double to_period = numer / rc->to_sbpm;
+	struct midi1_clock_ramp ramp;
+	double worst = 0.0;
+	uint32_t worst_clock = 0;
+	uint32_t period = 0;
+
+	midi1_clock_ramp_start(&ramp, from, rc->to_sbpm, rc->clocks, curve,
+			       clock_hz, rc->ppqn);
+	for (uint32_t k = 1; k <= rc->clocks; k++) {
+		double x = (double)k / rc->clocks;
+		double exact;
+		double ppm;
+
+		CHECK(midi1_clock_ramp_active(&ramp), "%u -> %u: stopped "
+		      "at clock %u", rc->from_sbpm, rc->to_sbpm, k);
+		period = midi1_clock_ramp_next(&ramp);
+		if (curve == MIDI1_CLOCK_RAMP_EXPONENTIAL) {
+			exact = from * pow(to_period / from, x);
+		} else {
+			exact = numer / (from_tempo +
+					 (rc->to_sbpm - from_tempo) * x);
+		}
+		/* Rounding to a tick is not the ramp's error */
+		ppm = (fabs(period - exact) - 0.5) / exact * 1e6;
+		if (ppm > worst) {
+			worst = ppm;
+			worst_clock = k;
+		}
+	}
+	CHECK(worst < RAMP_MAX_PPM, "%s %u -> %u: clock %u off %.1f ppm",
+	      curve == MIDI1_CLOCK_RAMP_EXPONENTIAL ? "exp" : "lin",
+	      rc->from_sbpm, rc->to_sbpm, worst_clock, worst);
+	CHECK(fabs(period - to_period) < to_period * RAMP_MAX_PPM / 1e6 + 0.5,
+	      "%u -> %u: last period %u, target %.1f", rc->from_sbpm,
+	      rc->to_sbpm, period, to_period);
+	CHECK(!midi1_clock_ramp_active(&ramp) &&
+	      midi1_clock_ramp_next(&ramp) == 0 && ramp.period == period,
+	      "%u -> %u: did not stop at the target", rc->from_sbpm,
+	      rc->to_sbpm);
+}
+
+static void test_ramp_linear(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(ramp_cases); i++) {
+		ramp_check(&ramp_cases[i], MIDI1_CLOCK_RAMP_LINEAR);
+	}
+}
+
+static void test_ramp_exponential(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(ramp_cases); i++) {
+		ramp_check(&ramp_cases[i], MIDI1_CLOCK_RAMP_EXPONENTIAL);
+	}
+}
+
+/* Zero clocks is a step change on the next clock */
+static void test_ramp_step(void)
+{
+	struct midi1_clock_ramp ramp;
+	uint32_t from = sbpm_to_ticks(12000, 48000000);
+	uint32_t to = sbpm_to_ticks(9000, 48000000);
+	uint32_t period;
+
+	midi1_clock_ramp_start(&ramp, from, 9000, 0, MIDI1_CLOCK_RAMP_LINEAR,
+			       48000000, 24);
+	period = midi1_clock_ramp_next(&ramp);
+	CHECK(period + 1 >= to && period <= to + 1, "period %u, target %u",
+	      period, to);
+	CHECK(!midi1_clock_ramp_active(&ramp), "still running");
+}
+
+/* -- midi1_clock_div.h -- */
+
+/* 96 PPQN master: 96, 48 and 24 PPQN, a 1/16 trigger, a quarter note */
+static const uint8_t dividers[] = { 1, 2, 3, 4, 6, 7, 24, 96 };
+
+/*
+ * Run an output from master tick 'from' to 'to', it must fire on the
+ * multiples of the divider only.  Returns how often it fired.
+ */
+static uint32_t div_run(uint8_t *count, uint8_t divider, uint32_t from,
+			uint32_t to)
+{
+	uint32_t fired = 0;
+
+	for (uint32_t n = from; n < to; n++) {
+		bool due = midi1_clock_div_tick(count, divider);
+
+		CHECK(due == (n % divider == 0), "divider %u tick %u: %s",
+		      divider, n, due ? "fired" : "did not fire");
+		fired += due;
+	}
+	return fired;
+}
+
+/* Added or enabled at any tick, it comes in phase with the tick count */
+static void test_div_phase(void)
+{
+	static const uint32_t starts[] = { 0, 1, 5, 23, 95, 96, 1000, 123457 };
+
+	for (size_t i = 0; i < ARRAY_SIZE(dividers); i++) {
+		for (size_t j = 0; j < ARRAY_SIZE(starts); j++) {
+			uint8_t d = dividers[i];
+			uint8_t count = midi1_clock_div_count(d, starts[j]);
+
+			CHECK(count >= 1 && count <= d, "divider %u at %u: "
+			      "count %u", d, starts[j], count);
+			div_run(&count, d, starts[j], starts[j] + 4 * 96);
+		}
+	}
+}
+
+/* A new divider is aligned at the next tick, as set_divider() does */
+static void test_div_change(void)
+{
+	for (size_t i = 0; i < ARRAY_SIZE(dividers); i++) {
+		for (size_t j = 0; j < ARRAY_SIZE(dividers); j++) {
+			uint8_t count = midi1_clock_div_count(dividers[i], 0);
+			uint32_t at = 96 + 13 * (uint32_t)j;
+			uint32_t fired;
+
+			div_run(&count, dividers[i], 0, at);
+			count = midi1_clock_div_count(dividers[j], at);
+			fired = div_run(&count, dividers[j], at, at + 2 * 96);
+			CHECK(fired == (at + 2 * 96 + dividers[j] - 1) /
+				       dividers[j] -
+				       (at + dividers[j] - 1) / dividers[j],
+			      "%u -> %u: fired %u times", dividers[i],
+			      dividers[j], fired);
+		}
+	}
+}
+
+/*
+ * Continue from a song position: the tick count jumps to the position
+ * in master ticks, 6 MIDI clocks of 4 master ticks per sixteenth.  A
+ * 1/16 trigger fires on the first tick of the song whatever sixteenth
+ * it is, a quarter note only on a beat.
+ */
+static void test_div_song_position(void)
+{
+	static const uint16_t sixteenths[] = { 0, 1, 3, 4, 17, 1023 };
+
+	for (size_t i = 0; i < ARRAY_SIZE(dividers); i++) {
+		for (size_t j = 0; j < ARRAY_SIZE(sixteenths); j++) {
+			uint8_t d = dividers[i];
+			uint32_t pos = (uint32_t)sixteenths[j] * 6 * 4;
+			uint8_t count = midi1_clock_div_count(d, 500);
+
+			div_run(&count, d, 500, 517);
+			count = midi1_clock_div_count(d, pos);
+			if (d == 24) {
+				CHECK(count == 1, "1/16 at %u: count %u",
+				      sixteenths[j], count);
+			}
+			div_run(&count, d, pos, pos + 4 * 96);
+		}
+	}
+}
+
+/* -- midi1_clock_groove.c -- */
+
+/*
+ * Two beats of swing per amount, note, pulse length and subdivision.
+ * The adjustments added up to the start of every pulse are its offset:
+ * (2 * s - 1) * q pulses for pulse q of the first note of a pair, the
+ * second note starts at 2 * s of the pair.  At the end of the beat the
+ * adjustments add up to 0.
+ */
+static void groove_swing_check(uint8_t percent, uint8_t note, uint32_t pulse,
+			       uint8_t subdiv)
+{
+	struct midi1_clock_groove_table table;
+	struct midi1_clock_groove groove;
+	int64_t offset = 0;
+
+	CHECK(midi1_clock_groove_table_swing(&table, percent, note, pulse,
+					     subdiv) == 0,
+	      "%u %% note %u: rejected", percent, note);
+	midi1_clock_groove_init(&groove, subdiv);
+	midi1_clock_groove_set(&groove, &table);
+	for (uint32_t n = 0; n < 2 * MIDI1_CLOCK_GROOVE_PULSES; n++) {
+		const uint32_t q = n % (2 * note);
+		/* Straight position in the pair plus the offset */
+		const int64_t at = (int64_t)q * pulse + offset;
+
+		CHECK(offset == (int64_t)(2 * percent - 100) *
+				(q <= note ? q : 2 * note - q) * pulse / 100,
+		      "%u %% note %u %u ticks /%u: pulse %u at offset %lld",
+		      percent, note, pulse, subdiv, n, (long long)offset);
+		if (q == note) {
+			const int64_t swung = (int64_t)2 * note * pulse *
+					      percent / 100;
+
+			CHECK(at >= swung - 1 && at <= swung + 1,
+			      "%u %% note %u: second note at %lld, not %lld",
+			      percent, note, (long long)at, (long long)swung);
+		}
+		for (uint8_t sub = 0; sub < subdiv; sub++) {
+			offset += midi1_clock_groove_next(&groove);
+		}
+		if (n % MIDI1_CLOCK_GROOVE_PULSES ==
+		    MIDI1_CLOCK_GROOVE_PULSES - 1) {
+			CHECK(offset == 0, "%u %% note %u: beat %lld ticks off",
+			      percent, note, (long long)offset);
+		}
+	}
+}
+
+static void test_groove_swing(void)
+{
+	static const uint8_t percents[] = { 50, 54, 66, 75 };
+	static const uint8_t notes[] = { MIDI1_CLOCK_GROOVE_16TH,
+					 MIDI1_CLOCK_GROOVE_8TH };
+	static const uint32_t pulse_ticks[] = { 1000000, 333333, 7 };
+	static const uint8_t subdivs[] = { 1, 4, 3 };
+
+	for (size_t a = 0; a < ARRAY_SIZE(percents); a++) {
+		for (size_t b = 0; b < ARRAY_SIZE(notes); b++) {
+			for (size_t c = 0; c < ARRAY_SIZE(pulse_ticks); c++) {
+				for (size_t d = 0; d < ARRAY_SIZE(subdivs); d++) {
+					groove_swing_check(percents[a], notes[b],
+							   pulse_ticks[c],
+							   subdivs[d]);
+				}
+			}
+		}
+	}
+}
+
+static void test_groove_invalid(void)
+{
+	struct midi1_clock_groove_table table;
+
+	CHECK(midi1_clock_groove_table_swing(&table, 49, 6, 1000, 1) ==
+	      -EINVAL, "49 %%");
+	CHECK(midi1_clock_groove_table_swing(&table, 76, 6, 1000, 1) ==
+	      -EINVAL, "76 %%");
+	CHECK(midi1_clock_groove_table_swing(&table, 66, 0, 1000, 1) ==
+	      -EINVAL, "note 0");
+	/* Two notes of 5 pulses do not fit a beat */
+	CHECK(midi1_clock_groove_table_swing(&table, 66, 5, 1000, 1) ==
+	      -EINVAL, "note 5");
+	CHECK(midi1_clock_groove_table_swing(&table, 66, 6, 1000, 0) ==
+	      -EINVAL, "subdiv 0");
+}
+
+/* A table set in the middle of a beat waits for the next one */
+static void test_groove_latch(void)
+{
+	struct midi1_clock_groove_table table;
+	struct midi1_clock_groove groove;
+	int32_t adjust;
+
+	midi1_clock_groove_table_swing(&table, 66, MIDI1_CLOCK_GROOVE_16TH,
+				       100000, 2);
+	midi1_clock_groove_init(&groove, 2);
+	for (uint32_t n = 0; n < 2 * 5; n++) {
+		midi1_clock_groove_next(&groove);
+	}
+	midi1_clock_groove_set(&groove, &table);
+	for (uint32_t n = 2 * 5; n < 2 * MIDI1_CLOCK_GROOVE_PULSES; n++) {
+		adjust = midi1_clock_groove_next(&groove);
+		CHECK(adjust == 0, "period %u: adjust %d before the beat", n,
+		      adjust);
+	}
+	adjust = midi1_clock_groove_next(&groove);
+	CHECK(adjust == table.adjust[0] + table.rest[0],
+	      "first period of the beat: adjust %d", adjust);
+
+	/* And back to straight, also from the next beat on */
+	midi1_clock_groove_set(&groove, NULL);
+	CHECK(midi1_clock_groove_active(&groove), "straight pending");
+	for (uint32_t n = 1; n < 2 * MIDI1_CLOCK_GROOVE_PULSES; n++) {
+		midi1_clock_groove_next(&groove);
+	}
+	CHECK(midi1_clock_groove_next(&groove) == 0 &&
+	      !midi1_clock_groove_active(&groove), "still swinging");
+}
+
+/* Seek to a song position: the after-th period is the first of pulse */
+static void test_groove_seek(void)
+{
+	struct midi1_clock_groove_table table;
+	struct midi1_clock_groove groove;
+
+	midi1_clock_groove_table_swing(&table, 75, MIDI1_CLOCK_GROOVE_8TH,
+				       100000, 4);
+	midi1_clock_groove_init(&groove, 4);
+	midi1_clock_groove_set(&groove, &table);
+	for (uint32_t n = 0; n < 4 * 3 + 1; n++) {
+		midi1_clock_groove_next(&groove);
+	}
+	midi1_clock_groove_seek(&groove, 9, 3);
+	midi1_clock_groove_next(&groove);
+	midi1_clock_groove_next(&groove);
+	CHECK(midi1_clock_groove_next(&groove) ==
+	      table.adjust[9] + table.rest[9], "not at pulse 9");
+	CHECK(groove.pulse == 9 && groove.sub == 1, "pulse %u sub %u",
+	      groove.pulse, groove.sub);
+}
+
+struct clock_test {
+	const char *name;
+	void (*fn)(void);
+};
+
+static const struct clock_test tests[] = {
+	{ "dds.hour", test_dds_hour },
+	{ "dds.rounded_drift", test_dds_rounded_drift },
+	{ "dds.div", test_dds_div },
+	{ "ramp.linear", test_ramp_linear },
+	{ "ramp.exponential", test_ramp_exponential },
+	{ "ramp.step", test_ramp_step },
+	{ "div.phase", test_div_phase },
+	{ "div.change", test_div_change },
+	{ "div.song_position", test_div_song_position },
+	{ "groove.swing", test_groove_swing },
+	{ "groove.invalid", test_groove_invalid },
+	{ "groove.latch", test_groove_latch },
+	{ "groove.seek", test_groove_seek },
+};
+
+int main(void)
+{
+	int failed = 0;
+
+	for (size_t i = 0; i < ARRAY_SIZE(tests); i++) {
+		unsigned int before = checks_failed;
+
+		tests[i].fn();
+		printf("%-28s %s\n", tests[i].name,
+		       checks_failed == before ? "ok" : "FAILED");
+		if (checks_failed != before) {
+			failed++;
+		}
+	}
+	return failed;
+}
+
+/* EOF */
@@ -0,0 +1,164 @@
+/**
+ * @file midi1_parser_ref.c
+ * @brief The MIDI1.0 receive parser before midi1_parser.c, see
+ * midi1_parser_ref.h
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <stddef.h>
+
+#include "midi1_defs.h"
+#include "midi1_parser_ref.h"
+
+void midi1_parser_ref_init(struct midi1_parser_ref *ps,
+			   const struct midi1_parser_ops *ops, void *ctx)
+{
+	ps->ops = ops;
+	ps->ctx = ctx;
+	ps->running_status_rx = 0;
+	ps->third_byte_flag = 0;
+	ps->midi_c2 = 0;
+	ps->midi_c3 = 0;
+}
+
+/* Takes the place of the delegates */
+static void midi1_parser_ref_message(struct midi1_parser_ref *ps,
+				     uint8_t type, uint8_t status,
+				     uint8_t d1, uint8_t d2)
+{
+	struct midi1_msg msg = {
+		.type = type,
+		.status = status,
+		.data1 = d1,
+		.data2 = d2,
+	};
+
+	ps->ops->message(ps->ctx, &msg);
+}
+
+/*
+ * We parse one byte at a time for the MIDI parsing. Then callback functions are called
+ * for each complete message
+ */
+void midi1_parser_ref_byte(struct midi1_parser_ref *ps, uint8_t c)
+{
+	/* Check if bit7 = 1 */
+	if (c & CHANNEL_VOICE_MASK) {
+		/* is it a real-time message?  0xF8 up to 0xFF */
+		if (c >= 0xF8) {
+			midi1_parser_ref_message(ps, MIDI1_MSG_REALTIME, c,
+						 0, 0);
+			return;
+		} else {
+			ps->running_status_rx = c;
+			ps->third_byte_flag = 0;
+			/* Is this a tune request */
+			if (c == SYSTEM_TUNE_REQUEST) {
+				ps->midi_c2 = c;
+				return;
+			}
+			return;
+		}
+	} else {		/* Bit 7 == 0   (data) */
+		if (ps->third_byte_flag == 1) {
+			ps->third_byte_flag = 0;
+			ps->midi_c3 = c;
+
+			/*
+			 * We don't care about the input channel (OMNI)
+			 * so what we are doing here is to set the lower 4 bits to 0.
+			 */
+			ps->running_status_rx &= 0xF0;
+			if (ps->running_status_rx == C_NOTE_ON) {
+				if (ps->midi_c3 == 0) {
+					/* Velocity zero "note on" is a "note-off" */
+					midi1_parser_ref_message(ps,
+						MIDI1_MSG_NOTE_OFF,
+						ps->running_status_rx,
+						ps->midi_c2, ps->midi_c3);
+					return;
+				} else {
+					midi1_parser_ref_message(ps,
+						MIDI1_MSG_NOTE_ON,
+						ps->running_status_rx,
+						ps->midi_c2, ps->midi_c3);
+					return;
+				}
+			} else if (ps->running_status_rx == C_NOTE_OFF) {
+				midi1_parser_ref_message(ps, MIDI1_MSG_NOTE_OFF,
+							 ps->running_status_rx,
+							 ps->midi_c2,
+							 ps->midi_c3);
+				return;
+			} else if (ps->running_status_rx == C_PITCH_WHEEL) {
+				midi1_parser_ref_message(ps,
+							 MIDI1_MSG_PITCH_WHEEL,
+							 ps->running_status_rx,
+							 ps->midi_c2,
+							 ps->midi_c3);
+				return;
+			} else if (ps->running_status_rx == C_PROGRAM_CHANGE) {
+				return;
+			} else if (ps->running_status_rx ==
+				   C_POLYPHONIC_AFTERTOUCH) {
+				return;
+			} else if (ps->running_status_rx ==
+				   C_CHANNEL_AFTERTOUCH) {
+				return;
+			} else if (ps->running_status_rx == C_CONTROL_CHANGE) {
+				midi1_parser_ref_message(ps,
+							 MIDI1_MSG_CONTROL_CHANGE,
+							 ps->running_status_rx,
+							 ps->midi_c2,
+							 ps->midi_c3);
+				return;
+			} else {
+				/* Ignore */
+				return;
+			}
+		} else {
+			if (ps->running_status_rx == 0) {
+				/* Ignore data Byte if running status is  0 */
+				return;
+			} else {
+				if (ps->running_status_rx < 0xC0) {	/* All 2 byte commands */
+					ps->third_byte_flag = 1;
+					ps->midi_c2 = c;
+					return;
+				} else if (ps->running_status_rx < 0xE0) {	/* All 1 byte commands */
+					ps->midi_c2 = c;
+					return;
+				} else if (ps->running_status_rx < 0xF0) {
+					ps->third_byte_flag = 1;
+					ps->midi_c2 = c;
+				} else if (ps->running_status_rx == 0xF2) {
+					ps->running_status_rx = 0;
+					ps->third_byte_flag = 1;
+					ps->midi_c2 = c;
+					return;
+				} else if (ps->running_status_rx == 0xF3) {
+					ps->running_status_rx = 0;
+					ps->midi_c2 = c;
+					return;
+				} else {
+					/* Ignore status */
+					ps->running_status_rx = 0;
+					return;
+				}
+			}
+		}		/* third_byte_flag */
+	}			/* end of data bit 7 == 0 */
+}
+
+void midi1_parser_ref_bytes(struct midi1_parser_ref *ps,
+			    const uint8_t *data, size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		midi1_parser_ref_byte(ps, data[i]);
+	}
+}
+
+/* EOF */
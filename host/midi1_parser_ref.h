@@ -0,0 +1,47 @@
+/**
+ * @file midi1_parser_ref.h
+ * @brief The MIDI1.0 receive parser as it was before midi1_parser.c,
+ * host only.
+ *
+ * @note
+ * SerialMidiReceiveParser() of the old midi1_serial.c with the globals
+ * moved into a struct and the delegates replaced by the message callback
+ * of struct midi1_parser_ops, nothing else changed.  midi1_bench uses
+ * it to check that the table driven parser gives the same events on the
+ * same stream, and to compare their speed.
+ *
+ * It only ever reported note on, note off, control change, pitch wheel
+ * and realtime.  The status of a channel message has the channel bits
+ * cleared (OMNI) and the system exclusive callbacks are never called.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_PARSER_REF_H
+#define MIDI1_PARSER_REF_H
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "midi1_parser.h"
+
+struct midi1_parser_ref {
+	const struct midi1_parser_ops *ops;
+	void *ctx;
+	uint8_t running_status_rx;
+	uint8_t third_byte_flag;
+	uint8_t midi_c2;
+	uint8_t midi_c3;
+};
+
+void midi1_parser_ref_init(struct midi1_parser_ref *ps,
+			   const struct midi1_parser_ops *ops, void *ctx);
+
+void midi1_parser_ref_byte(struct midi1_parser_ref *ps, uint8_t c);
+
+void midi1_parser_ref_bytes(struct midi1_parser_ref *ps,
+			    const uint8_t *data, size_t len);
+
+#endif /* MIDI1_PARSER_REF_H */
+/* EOF */
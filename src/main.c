@@ -39,6 +39,14 @@
  * MIDI1.0 serial 5 port DIN port support
  */
 #include "midi1_serial.h"
+#if MIDI1_SERIAL_TRACE
+#include "midi1_serial_trace.h"
+#endif
+
+/*
+ * DIN to USB bridge
+ */
+#include "midi1_bridge.h"
 
 /*
  * Functions for the MIDI software based clock timer.
@@ -49,6 +57,8 @@
  * Functions for the MIDI PIT0_CHANNEL0 hardware based clock timer.
  */
 #include "midi1_clock_counter.h"
+#include "midi1_clock_dds.h"
+#include "midi1_transport.h"
 
 /*
  * Adjustable MIDI clock we feed it with the PLL adjustments.
@@ -72,6 +82,36 @@
 
 /* ------------------------------------------------------------------------- */
 
+/*
+ * Follow the MIDI clock received on the DIN port instead of the one
+ * received over USB.
+ */
+#define MEASURE_DIN_CLOCK 0
+
+/* Forward the MIDI received on the DIN ports to USB */
+#define BRIDGE_DIN_TO_USB 1
+
+/*
+ * Forward the MIDI received over USB to DIN port 0.  The host clock and
+ * transport are left out while the generator clocks that port
+ * (MIDI1_CLOCK_CNTR_DIN_OUT).
+ */
+#define BRIDGE_USB_TO_DIN 1
+
+/*
+ * Send the bridged note offs as note on with velocity 0, chords from USB
+ * then stay in one running status on DIN.  The note off velocity is
+ * lost, only for gear that ignores it.
+ */
+#define BRIDGE_NOTE_OFF_AS_NOTE_ON 0
+
+/*
+ * Start/Stop/Continue and song position from the USB host drive the
+ * transport of the generated clock.  The generator sends them on its
+ * enabled outputs, on DIN they are not bridged then.
+ */
+#define FOLLOW_USB_TRANSPORT 1
+
 /* Provide the received 24pqn MIDI clock on a pin */
 #define RX_MIDI_CLOCK_ON_PIN 1
 #if RX_MIDI_CLOCK_ON_PIN
@@ -127,9 +167,48 @@ UMP_ENDPOINT_DT_SPEC_GET(USB_MIDI_DT_NODE);
 const struct ump_stream_responder_cfg responder_cfg =
 UMP_STREAM_RESPONDER(midi, usbd_midi_send, &ump_ep_dt);
 
+#if BRIDGE_USB_TO_DIN
+/*
+ * What the generator sends itself.  While it clocks the bridged DIN
+ * port the host clock stays off that port, two clocks there double the
+ * tempo.  Following the host (FOLLOW_USB_TRANSPORT) it also sends the
+ * host transport there, in step with its own clock.  With its DIN
+ * output disabled everything is bridged and the host clocks the port.
+ */
+static bool main_generated(const struct midi_ump ump)
+{
+	const struct midi1_clock_out *out =
+		midi1_clock_cntr_din_out(MIDI1_BRIDGE_DIN_PORT);
+	const bool din_clocked = out != NULL && out->enabled;
+
+	if (UMP_MT(ump) != UMP_MT_SYS_RT_COMMON) {
+		return false;
+	}
+	switch (UMP_MIDI_STATUS(ump)) {
+	case RT_TIMING_CLOCK:
+		return din_clocked;
+#if FOLLOW_USB_TRANSPORT
+	case RT_START:
+	case RT_CONTINUE:
+	case RT_STOP:
+	case SYSTEM_SONG_POSITION:
+		return din_clocked;
+#endif
+	default:
+		return false;
+	}
+}
+#endif
+
 /* TODO: work in progress handler for timing purposes */
 static void on_ump_packet(const struct device *dev, const struct midi_ump ump)
 {
+#if BRIDGE_USB_TO_DIN
+	/* Only queues, the DIN sender thread waits for the UART */
+	if (!main_generated(ump)) {
+		midi1_bridge_usb_packet(&ump);
+	}
+#endif
 	switch (UMP_MT(ump)) {
 	case UMP_MT_SYS_RT_COMMON:
 		uint8_t status = UMP_MIDI_STATUS(ump);
@@ -141,11 +220,30 @@ static void on_ump_packet(const struct device *dev, const struct midi_ump ump)
 			 * on the scope the incoming clock.
 			 */
 			gpio_pin_toggle_dt(&rx_midi_clk_pin);
+#endif
+#if MEASURE_DIN_CLOCK
+			break;
 #endif
 			midi1_clock_meas_cntr_pulse();
 			midi1_pll_ticks_process_interval
 			    (midi1_clock_meas_cntr_interval_ticks());
 			break;
+#if FOLLOW_USB_TRANSPORT
+		/* Carried out on the next generated clock */
+		case RT_START:	/* Start */
+			midi1_transport_start();
+			break;
+		case RT_CONTINUE:	/* Continue */
+			midi1_transport_continue();
+			break;
+		case RT_STOP:	/* Stop */
+			midi1_transport_stop();
+			break;
+		case SYSTEM_SONG_POSITION:
+			midi1_transport_set_song_position(
+				UMP_MIDI1_P1(ump) | (UMP_MIDI1_P2(ump) << 7));
+			break;
+#endif
 		default:
 			break;
 		}
@@ -197,11 +295,13 @@ static void on_midi_packet(const struct device *dev, const struct midi_ump ump)
 			midi1_clock_adj_set_interval_us(interval_us);
 			break;
 		case RT_START:	/* Start */
+			midi1_transport_start();
 			break;
 		case RT_CONTINUE:	/* Continue */
-			/* optional: resume measurement */
+			midi1_transport_continue();
 			break;
 		case RT_STOP:	/* Stop */
+			midi1_transport_stop();
 			break;
 		default:
 			break;
@@ -247,40 +347,288 @@ static const struct usbd_midi_ops ops = {
 
 
 /**
- * @brief Callbacks/delegates for 'midi1_serial.c' after parsing MIDI1.0
+ * @brief Handlers for the events of 'midi1_serial.c' after parsing MIDI1.0
  *
  * @note
  * Do not block in these function as they are called from the MIDI
- * parser this one is blocked untill the delegate is finished.
+ * parser this one is blocked untill the listener is finished.
  */
-void note_on_handler(uint8_t note, uint8_t velocity) {
-	printk("Note  on: %03d %03d\n", note, velocity);
+void note_on_handler(uint8_t channel, uint8_t note, uint8_t velocity) {
+	printk("Note  on: ch %02d %03d %03d\n", channel + 1, note, velocity);
 }
 
-void note_off_handler(uint8_t note, uint8_t velocity) {
-	printk("Note off: %03d %03d\n", note, velocity);
+void note_off_handler(uint8_t channel, uint8_t note, uint8_t velocity) {
+	printk("Note off: ch %02d %03d %03d\n", channel + 1, note, velocity);
 }
 
-void midi_pitchwheel_handler(uint8_t lsb, uint8_t msb) {
+void midi_pitchwheel_handler(uint8_t channel, uint8_t lsb, uint8_t msb) {
 	/* 14 bit value for the pitch wheel  */
 	int16_t pwheel = (int16_t)((msb << 7) | lsb) - PITCHWHEEL_CENTER ;
 	
 	/* print on the serial out */
-	printk("Pitchwheel: %d\n", pwheel);
+	printk("Pitchwheel: ch %02d %d\n", channel + 1, pwheel);
+}
+
+void control_change_handler_model(uint8_t channel, uint8_t controller,
+				  uint8_t value) {
+	printk("Control change: ch %02d %d %d\n", channel + 1, controller,
+	       value);
 }
 
-void control_change_handler_model(uint8_t controller, uint8_t value) {
-	printk("Control change: %d %d\n", controller, value);
+void control_change_handler(uint8_t channel, uint8_t controller,
+			    uint8_t value) {
+	printk("Control change: ch %02d %d %d\n", channel + 1, controller,
+	       value);
 }
 
-void control_change_handler(uint8_t controller, uint8_t value) {
-	printk("Control change: %d %d\n", controller, value);
+/* 14 bit controllers 0..31 and RPN/NRPN, already assembled */
+void control_change14_handler(uint8_t channel, uint8_t controller,
+			      uint16_t value) {
+	printk("Control change 14: ch %02d %d %d\n", channel + 1, controller,
+	       value);
 }
 
-void realtime_handler(uint8_t msg) {
+void parameter_handler(uint8_t channel, bool nrpn, uint16_t param,
+		       uint16_t value) {
+	printk("%s: ch %02d %d %d\n", nrpn ? "NRPN" : "RPN", channel + 1,
+	       param, value);
+}
+
+void realtime_handler(uint8_t msg, uint32_t timestamp) {
+#if MEASURE_DIN_CLOCK
+	if (msg == RT_TIMING_CLOCK) {
+		/* timestamp was taken in the UART ISR */
+		midi1_clock_meas_cntr_pulse_ts(timestamp);
+		midi1_pll_ticks_process_interval
+		    (midi1_clock_meas_cntr_interval_ticks());
+		return;
+	}
+#endif
 	printk("Realtime: %d\n", msg);
 }
 
+void midi_message_handler(uint8_t status, uint8_t d1, uint8_t d2) {
+	printk("Message: %02X %d %d\n", status, d1, d2);
+}
+
+/* One listener per DIN port, it hands the events to the handlers above */
+static void din_event_listener(uint8_t port,
+			       const struct serial_midi_event *events,
+			       size_t count, void *user_data)
+{
+	for (size_t i = 0; i < count; i++) {
+		const struct serial_midi_event *ev = &events[i];
+		uint8_t channel = serial_midi_event_channel(ev);
+
+		switch (ev->type) {
+		case SERIAL_MIDI_EV_NOTE_ON:
+			note_on_handler(channel, ev->data1, ev->data2);
+			break;
+		case SERIAL_MIDI_EV_NOTE_OFF:
+			note_off_handler(channel, ev->data1, ev->data2);
+			break;
+		case SERIAL_MIDI_EV_CONTROL_CHANGE:
+			control_change_handler(channel, ev->data1, ev->data2);
+			break;
+		case SERIAL_MIDI_EV_PITCH_WHEEL:
+			midi_pitchwheel_handler(channel, ev->data1, ev->data2);
+			break;
+		case SERIAL_MIDI_EV_REALTIME:
+			realtime_handler(ev->status, ev->timestamp);
+			break;
+		case SERIAL_MIDI_EV_CC14:
+			control_change14_handler(channel, ev->param, ev->value);
+			break;
+		case SERIAL_MIDI_EV_RPN:
+		case SERIAL_MIDI_EV_NRPN:
+			parameter_handler(channel,
+					  ev->type == SERIAL_MIDI_EV_NRPN,
+					  ev->param, ev->value);
+			break;
+		default:
+			midi_message_handler(ev->status, ev->data1, ev->data2);
+			break;
+		}
+	}
+}
+
+static struct serial_midi_listener din_listeners[SERIAL_MIDI_MAX_PORTS];
+
+void midi_sysex_handler(struct serial_midi_sysex_chunk *chunk) {
+	printk("SysEx chunk: %u bytes flags %02X\n", chunk->len, chunk->flags);
+	/* Done with it, give it back to the parser */
+	SerialMidiSysexChunkFree(chunk);
+}
+
+
+/*
+ * Parser and encoder throughput on the target.  midi1_parser.c and the
+ * midi1_* encoders have no hardware behind them, so this measures only
+ * the protocol code: a synthetic stream of running status notes,
+ * controllers, clocks and system exclusive is parsed and every message
+ * is encoded to UMP.  host/midi1_bench.c does the same off target with
+ * a baseline to compare with, this gives the M0+ cycles.
+ */
+#define TEST_PARSER_BENCH 0
+#if TEST_PARSER_BENCH
+#define PARSER_BENCH_ROUNDS 1000
+
+static uint32_t parser_bench_msgs;
+static uint32_t parser_bench_sysex;
+static volatile uint32_t parser_bench_sink;
+
+static void parser_bench_message(void *ctx, const struct midi1_msg *msg)
+{
+	struct midi_ump ump;
+
+	if (msg->type == MIDI1_MSG_CONTROL_CHANGE) {
+		ump = midi1_controlchange(msg->status & CHANNEL_MASK,
+					  msg->data1, msg->data2);
+	} else if (msg->type <= MIDI1_MSG_NOTE_ON) {
+		ump = midi1_note_on(msg->status & CHANNEL_MASK,
+				    msg->data1, msg->data2);
+	} else {
+		ump = midi1_system_message(msg->status, msg->data1,
+					   msg->data2);
+	}
+	parser_bench_sink += ump.data[0];
+	parser_bench_msgs++;
+}
+
+static void parser_bench_sysex_byte(void *ctx, uint8_t c)
+{
+	parser_bench_sysex++;
+}
+
+static const struct midi1_parser_ops parser_bench_ops = {
+	.message = parser_bench_message,
+	.sysex_byte = parser_bench_sysex_byte,
+};
+
+static void parser_bench(void)
+{
+	static uint8_t corpus[256];
+	struct midi1_parser ps;
+	uint32_t len = 0;
+	uint32_t start, cycles;
+	uint64_t us;
+
+	/* Chord with running status, a CC sweep, clocks in between */
+	corpus[len++] = C_NOTE_ON;
+	for (int i = 0; i < 16; i++) {
+		corpus[len++] = 60 + i;
+		corpus[len++] = (i & 1) ? 0 : 100;
+	}
+	corpus[len++] = C_CONTROL_CHANGE;
+	for (int i = 0; i < 32; i++) {
+		corpus[len++] = CTL_MSB_MODWHEEL;
+		corpus[len++] = i * 4;
+		if ((i & 7) == 0) {
+			corpus[len++] = RT_TIMING_CLOCK;
+		}
+	}
+	corpus[len++] = SYSTEM_EXCLUSIVE_START;
+	for (int i = 0; i < 64; i++) {
+		corpus[len++] = i;
+	}
+	corpus[len++] = SYSTEM_EXCLUSIVE_END;
+
+	midi1_parser_init(&ps, &parser_bench_ops, NULL);
+	start = k_cycle_get_32();
+	for (int r = 0; r < PARSER_BENCH_ROUNDS; r++) {
+		midi1_parser_bytes(&ps, corpus, len);
+	}
+	cycles = k_cycle_get_32() - start;
+	us = k_cyc_to_us_floor64(cycles);
+
+	printk("parser bench: %u bytes %u msgs %u sysex bytes %u errors\n",
+	       len * PARSER_BENCH_ROUNDS, parser_bench_msgs,
+	       parser_bench_sysex, ps.errors);
+	printk("parser bench: %u cycles/byte, %u msgs/s\n",
+	       cycles / (len * PARSER_BENCH_ROUNDS),
+	       us ? (uint32_t)((uint64_t)parser_bench_msgs * 1000000U / us) : 0);
+}
+#endif
+
+/*
+ * Song position and Continue leave DIN port 0 in that order, with
+ * clocks waiting in the realtime lane and notes in the TX ring ahead of
+ * them.  The clocks queued before go out first, then F2 lsb msb FB and
+ * only then the clocks queued after the Continue.  Needs
+ * MIDI1_SERIAL_TX_TAP, no loopback cable.
+ */
+#define TEST_SPP_CONTINUE_ORDER 0
+#if TEST_SPP_CONTINUE_ORDER && MIDI1_SERIAL_TX_TAP
+#define SPP_TEST_POSITION 0x1234
+#define SPP_TEST_CLOCKS_BEFORE 8
+#define SPP_TEST_CLOCKS_AFTER 4
+
+static uint8_t spp_test_bytes[64];
+static atomic_t spp_test_count;
+
+static void spp_test_tap(uint8_t port, uint8_t c)
+{
+	uint32_t n = (uint32_t)atomic_inc(&spp_test_count);
+
+	if (n < ARRAY_SIZE(spp_test_bytes)) {
+		spp_test_bytes[n] = c;
+	}
+}
+
+static void spp_continue_order_test(void)
+{
+	static const uint8_t expect[] = {
+		SYSTEM_SONG_POSITION, SPP_TEST_POSITION & MIDI_DATA,
+		(SPP_TEST_POSITION >> 7) & MIDI_DATA, RT_CONTINUE,
+	};
+	uint32_t clocks_before = 0;
+	uint32_t clocks_after = 0;
+	uint32_t at = UINT32_MAX;
+	uint32_t n;
+	bool ok;
+
+	atomic_set(&spp_test_count, 0);
+	SerialMidiSetTxTap(0, spp_test_tap);
+	/* A busy ring, the clocks in the lane go out before all of it */
+	for (int i = 0; i < SPP_TEST_CLOCKS_BEFORE; i++) {
+		SerialMidiNoteON(0, 0, 60 + i, 100);
+		SerialMidiTimingClock(0);
+	}
+	SerialMidiSongPositionContinue(0, SPP_TEST_POSITION);
+	for (int i = 0; i < SPP_TEST_CLOCKS_AFTER; i++) {
+		SerialMidiTimingClock(0);
+	}
+	/* 8 notes, the position and the clocks are ~10 ms at 31250 baud */
+	k_msleep(50);
+	SerialMidiSetTxTap(0, NULL);
+
+	n = MIN((uint32_t)atomic_get(&spp_test_count),
+		ARRAY_SIZE(spp_test_bytes));
+	for (uint32_t i = 0; i < n; i++) {
+		if (at == UINT32_MAX && i + ARRAY_SIZE(expect) <= n &&
+		    memcmp(&spp_test_bytes[i], expect, sizeof(expect)) == 0) {
+			at = i;
+			i += ARRAY_SIZE(expect) - 1;
+			continue;
+		}
+		if (spp_test_bytes[i] != RT_TIMING_CLOCK) {
+			continue;
+		}
+		if (at == UINT32_MAX) {
+			clocks_before++;
+		} else {
+			clocks_after++;
+		}
+	}
+	/* No clock between the position and Continue or ahead of them */
+	ok = at != UINT32_MAX && clocks_before == SPP_TEST_CLOCKS_BEFORE &&
+	     clocks_after == SPP_TEST_CLOCKS_AFTER;
+	printk("test: song position then continue on DIN %s (%u bytes, "
+	       "clocks %u before %u after)\n", ok ? "ok" : "FAILED", n,
+	       clocks_before, clocks_after);
+}
+#endif
+
 
 /* ------------------------- INIT functions -------------------------------- */
 /*
@@ -330,13 +678,23 @@ int main_midi_init()
 	midi1_pll_ticks_init(12000);
 	
 	/* defined in midi1_serial.h */
-	/* Initialize the MIDI parser with the callbacks */
-	SerialMidiInit(&note_on_handler,
-		       &note_off_handler,
-		       &control_change_handler,
-		       &realtime_handler,
-		       &midi_pitchwheel_handler);
-	printk("MIDI1.0 serial initialized\n");
+	/* Initialize the MIDI parser of every DIN port with a listener */
+	for (uint8_t port = 0; port < SerialMidiNumPorts(); port++) {
+		SerialMidiInit(port);
+		din_listeners[port].fn = din_event_listener;
+		din_listeners[port].type_mask = SERIAL_MIDI_EV_ALL |
+						SERIAL_MIDI_EV_ASSEMBLED;
+		SerialMidiAddListener(port, &din_listeners[port]);
+		SerialMidiSetSysexHandler(port, &midi_sysex_handler);
+	}
+#if BRIDGE_USB_TO_DIN && BRIDGE_NOTE_OFF_AS_NOTE_ON
+	SerialMidiSetNoteOffAsNoteOn(MIDI1_BRIDGE_DIN_PORT, true);
+#endif
+#if BRIDGE_DIN_TO_USB
+	/* Everything received on DIN also goes out over USB */
+	midi1_bridge_init(midi);
+#endif
+	printk("MIDI1.0 serial initialized %u port(s)\n", SerialMidiNumPorts());
 	
 	/*
 	 * Send example MIDI messages to test the DIN5 MIDI1.0
@@ -346,24 +704,97 @@ int main_midi_init()
 	for (int j =0 ; j < 16; j++ ) {
 		for (int i = 0; i < 16; i++) {
 			printk("MIDI1.0 serial NoteON\n");
-			SerialMidiNoteON(j,60,i);
+			SerialMidiNoteON(0,j,60,i);
 			k_msleep(100);
 		}
 		for (int i = 0; i < 16; i++) {
 			printk("MIDI1.0 serial NoteON (velocity=0)\n");
-			SerialMidiNoteON(j,60,0);
+			SerialMidiNoteON(0,j,60,0);
 			k_msleep(100);
 		}
 		k_msleep(2000);
 	}
 #endif
+
+	/*
+	 * Replay a dense UMP stream through the USB to DIN bridge as if the
+	 * host sent it: chords, controller sweeps and pitch bends with a
+	 * clock in between.  Reports DIN bytes per message and the delay.
+	 */
+#define TEST_USB_TO_DIN_REPLAY 0
+#if TEST_USB_TO_DIN_REPLAY && BRIDGE_USB_TO_DIN
+	struct serial_midi_stats din_before, din_after;
+	struct midi1_bridge_din_stats replay;
+	struct midi_ump ump;
+
+	SerialMidiGetStats(MIDI1_BRIDGE_DIN_PORT, &din_before);
+	for (int i = 0; i < 1000; i++) {
+		switch (i % 8) {
+		case 0: case 1: case 2:
+			/* three note chord */
+			ump = midi1_note_on(0, 60 + 4 * (i % 8), 100);
+			break;
+		case 3: case 4:
+			ump = midi1_controlchange(0, CTL_MSB_MODWHEEL, i & 0x7F);
+			break;
+		case 5:
+			ump = midi1_pitchwheel(0, (i * 64) & 0x3FFF);
+			break;
+		case 6:
+			ump = midi1_timing_clock();
+			break;
+		default:
+			ump = midi1_note_on(0, 60, 0);
+			break;
+		}
+		midi1_bridge_usb_packet(&ump);
+		/* About what a busy host sends, faster than DIN can carry */
+		k_usleep(500);
+	}
+	/* Let the DIN output drain */
+	k_msleep(1000);
+	SerialMidiGetStats(MIDI1_BRIDGE_DIN_PORT, &din_after);
+	midi1_bridge_get_din_stats(&replay);
+	if (replay.sent) {
+		printk("replay: %u sent %u dropped, %u DIN bytes/100 msg, "
+		       "delay avg %u us max %u us, coalesced %u\n",
+		       replay.sent, replay.dropped,
+		       (din_after.tx_bytes - din_before.tx_bytes) * 100 /
+		       replay.sent,
+		       replay.latency_sum_us / replay.sent,
+		       replay.latency_max_us,
+		       din_after.tx_coalesced - din_before.tx_coalesced);
+		printk("replay: DIN tx queue delay p50 %u us p99 %u us\n",
+		       din_after.tx_delay_p50_us, din_after.tx_delay_p99_us);
+	}
+#endif
+
+#if TEST_PARSER_BENCH
+	parser_bench();
+#endif
+#if TEST_SPP_CONTINUE_ORDER && MIDI1_SERIAL_TX_TAP
+	spp_continue_order_test();
+#endif
 	return 0;
 }
 
 /* ---------------------------- THREADS ------------------------------------ */
 
 /*
- * MIDI1.0 5PIN DIN serial receive parser thread. 
+ * Sends the clock ticks the counter ISR queued.  Higher priority than
+ * the other threads, the ISR timestamp tells how late it was.
+ */
+void midi1_clock_send_thread(void) {
+	while (1) {
+		/* This one is blocking */
+		midi1_clock_cntr_sender();
+	}
+}
+K_THREAD_DEFINE(midi1_clock_send_tid, 512,
+		midi1_clock_send_thread, NULL, NULL, NULL, 2, 0, 0);
+
+/*
+ * MIDI1.0 5PIN DIN serial receive parser thread, serves all DIN ports.
  */
 void midi1_serial_receive_thread(void) {
 	while (1) {
@@ -374,6 +805,35 @@ void midi1_serial_receive_thread(void) {
 K_THREAD_DEFINE(midi1_serial_receive_tid, 512,
 		midi1_serial_receive_thread, NULL, NULL, NULL, 5, 0, 0);
 
+#if BRIDGE_DIN_TO_USB
+/*
+ * Sends what the DIN to USB bridge queued, a whole batch per wakeup.
+ */
+void midi1_bridge_usb_thread(void) {
+	while (1) {
+		/* This one is blocking */
+		midi1_bridge_usb_sender();
+	}
+}
+K_THREAD_DEFINE(midi1_bridge_usb_tid, 512,
+		midi1_bridge_usb_thread, NULL, NULL, NULL, 5, 0, 0);
+#endif
+
+#if BRIDGE_USB_TO_DIN
+/*
+ * Writes what the USB to DIN bridge queued, this is the thread that
+ * waits when the DIN output is full.
+ */
+void midi1_bridge_din_thread(void) {
+	while (1) {
+		/* This one is blocking */
+		midi1_bridge_din_sender();
+	}
+}
+K_THREAD_DEFINE(midi1_bridge_din_tid, 512,
+		midi1_bridge_din_thread, NULL, NULL, NULL, 5, 0, 0);
+#endif
+
 
 /*
  * This blinks LED2 (blue) in the interval received via MIDI-USB on
@@ -420,6 +880,158 @@ void led_blink_thread(void)
 K_THREAD_DEFINE(led_blink_tid, 512,
 		led_blink_thread, NULL, NULL, NULL, 5, 0, 0);
 
+/*
+ * 1000 tempo changes on the running clock, each at a random point in
+ * the period.  Every interval between two clock ISR timestamps must lie
+ * between the tempo before and the tempo after the change, a restart of
+ * the counter would show up as a short period.  The measurement counter
+ * is the other channel of the same PIT so the ticks compare directly.
+ */
+#define TEST_TEMPO_CHANGES 0
+#if TEST_TEMPO_CHANGES
+#define TEMPO_TEST_CHANGES 1000
+
+/* Timestamp of the next clock sent, false when clocks were missed */
+static bool tempo_test_next_clock(uint32_t *clocks, uint32_t *ts)
+{
+	struct midi1_clock_cntr_stats st;
+	uint32_t before = *clocks;
+
+	do {
+		k_usleep(100);
+		midi1_clock_cntr_get_stats(&st);
+	} while (st.clocks == before);
+	*clocks = st.clocks;
+	*ts = st.last_timestamp;
+	return st.clocks - before == 1;
+}
+
+static void tempo_change_test(uint32_t base_ticks)
+{
+	struct midi1_clock_cntr_stats st;
+	/* tempo[0] was set at the last clock, tempo[1] the one before */
+	uint32_t tempo[2] = { base_ticks, base_ticks };
+	/* ISR entry jitter, 10 us */
+	uint32_t tolerance = midi1_clock_cntr_cpu_frequency() / 100000;
+	uint32_t seed = 12345;
+	uint32_t clocks, ts, prev_ts, interval, lo, hi, next, half_us;
+	uint32_t checked = 0, failures = 0, skip = 2;
+
+	midi1_clock_cntr_get_stats(&st);
+	clocks = st.clocks;
+	tempo_test_next_clock(&clocks, &prev_ts);
+
+	for (int i = 0; i < TEMPO_TEST_CHANGES; i++) {
+		if (!tempo_test_next_clock(&clocks, &ts)) {
+			skip = 2;
+		}
+		/*
+		 * tempo[0] was written in the period that just ended, its
+		 * master ticks before that ran with tempo[1] and the ones
+		 * after with tempo[0], so it is a mix of the two.
+		 */
+		interval = prev_ts - ts;
+		lo = MIN(tempo[0], tempo[1]);
+		hi = MAX(tempo[0], tempo[1]);
+		if (skip) {
+			skip--;
+		} else {
+			checked++;
+			if (interval + tolerance < lo ||
+			    interval > hi + tolerance) {
+				failures++;
+				printk("tempo test: clock %u ts %u interval %u "
+				       "not in %u..%u\n", clocks, ts, interval,
+				       lo, hi);
+			}
+		}
+		if (i % 100 == 0) {
+			printk("tempo test: clock %u ts %u interval %u\n",
+			       clocks, ts, interval);
+		}
+		prev_ts = ts;
+
+		/*
+		 * +-10 %, written somewhere in the first half of the period
+		 * that is running now, that one has tempo[0].
+		 */
+		seed = seed * 1103515245U + 12345U;
+		next = base_ticks - base_ticks / 10 +
+		       (seed >> 8) % (base_ticks / 5);
+		half_us = (uint64_t)tempo[0] * 500000U /
+			  midi1_clock_cntr_cpu_frequency();
+		k_usleep((seed >> 4) % half_us);
+		midi1_clock_cntr_update_ticks(next);
+		tempo[1] = tempo[0];
+		tempo[0] = next;
+	}
+	midi1_clock_cntr_update_ticks(base_ticks);
+	printk("tempo test: %u changes, %u periods checked, %u out of range\n",
+	       TEMPO_TEST_CHANGES, checked, failures);
+}
+#endif
+
+/*
+ * Swing on the generated clock: restart with 66 % 16th note swing, the
+ * table has taken over by the second beat.  Every interval of that
+ * beat is compared with the stretched or squeezed pulse it should be.
+ */
+#define TEST_SWING 0
+#if TEST_SWING
+static void swing_test(uint32_t base_ticks)
+{
+	const uint8_t percent = 66;
+	const uint8_t note = MIDI1_CLOCK_GROOVE_16TH;
+	/* ISR entry jitter, 10 us */
+	uint32_t tolerance = midi1_clock_cntr_cpu_frequency() / 100000;
+	struct midi1_clock_cntr_stats st;
+	uint32_t start, pulse, expect, interval, prev_ts = 0;
+	uint32_t failures = 0;
+
+	if (midi1_clock_cntr_swing(percent, note) != 0) {
+		printk("swing test: no swing on this counter\n");
+		return;
+	}
+	midi1_clock_cntr_get_stats(&st);
+	start = st.clocks;
+	midi1_clock_cntr_ticks_start(base_ticks);
+
+	for (uint32_t seen = start; seen - start < 2 * MIDI1_CLOCK_GROOVE_PULSES;) {
+		do {
+			k_usleep(100);
+			midi1_clock_cntr_get_stats(&st);
+		} while (st.clocks == seen);
+		if (st.clocks - seen != 1) {
+			printk("swing test: missed clocks\n");
+			failures++;
+		}
+		seen = st.clocks;
+		/* Pulse of the clock that ended the interval */
+		pulse = seen - start - 1;
+		if (pulse > MIDI1_CLOCK_GROOVE_PULSES) {
+			interval = prev_ts - st.last_timestamp;
+			/* The interval before pulse - 1 */
+			if ((pulse - 1) % (2 * note) < note) {
+				expect = (uint64_t)base_ticks * 2 * percent / 100;
+			} else {
+				expect = (uint64_t)base_ticks * 2 *
+					 (100 - percent) / 100;
+			}
+			if (interval + tolerance < expect ||
+			    interval > expect + tolerance) {
+				failures++;
+			}
+			printk("swing test: pulse %u interval %u expect %u\n",
+			       (pulse - 1) % MIDI1_CLOCK_GROOVE_PULSES,
+			       interval, expect);
+		}
+		prev_ts = st.last_timestamp;
+	}
+	midi1_clock_cntr_swing(MIDI1_CLOCK_GROOVE_STRAIGHT, note);
+	printk("swing test: %u out of range\n", failures);
+}
+#endif
+
 #include "banner.h"
 /**
  * Main thread - this may actually terminate normally (code 0) in zephyr.
@@ -446,6 +1058,50 @@ int main(void)
 	/* Set the initial clock again because the PLL gets a init of 120 */
 	uint32_t pll_ticks = midi1_pll_ticks_get_interval_ticks();
 	midi1_clock_cntr_ticks_start(pll_ticks);
+
+#if TEST_TEMPO_CHANGES
+	tempo_change_test(pll_ticks);
+#endif
+#if TEST_SWING
+	swing_test(pll_ticks);
+#endif
+
+	/*
+	 * Accelerando over 8 beats, exponential ritardando back, then a
+	 * ramp cancelled halfway.  The stats give the worst case cycles a
+	 * ramp adds to the clock ISR.
+	 */
+#define TEST_TEMPO_RAMP 0
+#if TEST_TEMPO_RAMP
+	{
+		struct midi1_clock_cntr_stats ramp_stats;
+		uint16_t sbpm = 12000;
+
+		midi1_clock_cntr_update_sbpm(sbpm);
+		midi1_clock_cntr_ramp(sbpm + 4000, 8, MIDI1_CLOCK_RAMP_LINEAR);
+		while (midi1_clock_cntr_ramp_active()) {
+			k_msleep(10);
+		}
+		printk("ramp: up at %s\n",
+		       sbpm_to_str(midi1_clock_cntr_get_sbpm()));
+		midi1_clock_cntr_ramp(sbpm, 8, MIDI1_CLOCK_RAMP_EXPONENTIAL);
+		while (midi1_clock_cntr_ramp_active()) {
+			k_msleep(10);
+		}
+		printk("ramp: down at %s\n",
+		       sbpm_to_str(midi1_clock_cntr_get_sbpm()));
+		midi1_clock_cntr_ramp(sbpm / 2, 8, MIDI1_CLOCK_RAMP_LINEAR);
+		k_msleep(2000);
+		midi1_clock_cntr_ramp_cancel();
+		printk("ramp: cancelled at %s\n",
+		       sbpm_to_str(midi1_clock_cntr_get_sbpm()));
+		midi1_clock_cntr_get_stats(&ramp_stats);
+		printk("ramp: worst case %u cycles/clock (%u us)\n",
+		       ramp_stats.ramp_cycles_max,
+		       k_cyc_to_us_floor32(ramp_stats.ramp_cycles_max));
+		midi1_clock_cntr_update_ticks(pll_ticks);
+	}
+#endif
 	
 
 	while (1) {
@@ -461,16 +1117,125 @@ int main(void)
 		/* Get pll ticks */
 		uint32_t pll_ticks = midi1_pll_ticks_get_interval_ticks();
 		printk("main: PLL ticks     : %d\n", pll_ticks);
-		
+
+		/* DIN receive throughput: bytes parsed per parser wakeup */
+		for (uint8_t port = 0; port < SerialMidiNumPorts(); port++) {
+			struct serial_midi_stats din_stats;
+
+			SerialMidiGetStats(port, &din_stats);
+			if (din_stats.rx_wakeups) {
+				printk("main: DIN%u rx %u bytes/wakeup (max %u) "
+				       "ovf %u\n", port,
+				       din_stats.rx_bytes / din_stats.rx_wakeups,
+				       din_stats.rx_max_burst,
+				       din_stats.rx_overflow);
+			}
+			if (din_stats.rx_bytes) {
+				printk("main: DIN%u parser %u cycles/byte\n",
+				       port, din_stats.rx_parse_cycles /
+				       din_stats.rx_bytes);
+			}
+			printk("main: DIN%u util tx %u%% rx %u%% tx hwm %u "
+			       "rs saved %u (note off %u) rx errors %u\n", port,
+			       din_stats.tx_utilization,
+			       din_stats.rx_utilization,
+			       din_stats.tx_queue_high_water,
+			       din_stats.tx_running_status_saved,
+			       din_stats.tx_note_off_saved,
+			       din_stats.rx_parse_errors);
+			if (din_stats.tx_bytes) {
+				printk("main: DIN%u tx delay p50 %u us p90 %u us "
+				       "p99 %u us\n", port,
+				       din_stats.tx_delay_p50_us,
+				       din_stats.tx_delay_p90_us,
+				       din_stats.tx_delay_p99_us);
+			}
+			if (din_stats.tx_coalesced) {
+				printk("main: DIN%u tx %u coalesced\n", port,
+				       din_stats.tx_coalesced);
+			}
+			if (din_stats.tx_dropped || din_stats.tx_rt_dropped) {
+				printk("main: DIN%u tx dropped %u realtime %u\n",
+				       port, din_stats.tx_dropped,
+				       din_stats.tx_rt_dropped);
+			}
+#if MIDI1_SERIAL_TX_RT_MEASURE
+			if (din_stats.tx_rt_bytes) {
+				/* Time a clock byte waited for the UART */
+				printk("main: DIN%u tx clock delay avg %u us "
+				       "max %u us\n", port,
+				       k_cyc_to_us_floor32(din_stats.tx_rt_delay_sum /
+							   din_stats.tx_rt_bytes),
+				       k_cyc_to_us_floor32(din_stats.tx_rt_delay_max));
+			}
+#endif
+		}
+#if MIDI1_SERIAL_TRACE
+		/* Bytes received since the last print */
+		midi1_serial_trace_dump();
+		midi1_serial_trace_clear();
+#endif
+#if BRIDGE_USB_TO_DIN
+		struct midi1_bridge_din_stats din_bridge_stats;
+
+		midi1_bridge_get_din_stats(&din_bridge_stats);
+		if (din_bridge_stats.sent) {
+			printk("main: USB->DIN %u sent latency avg %u us "
+			       "max %u us dropped %u errors %u\n",
+			       din_bridge_stats.sent,
+			       din_bridge_stats.latency_sum_us /
+			       din_bridge_stats.sent,
+			       din_bridge_stats.latency_max_us,
+			       din_bridge_stats.dropped,
+			       din_bridge_stats.send_errors);
+		}
+#endif
+#if BRIDGE_DIN_TO_USB
+		struct midi1_bridge_stats bridge_stats;
+
+		midi1_bridge_get_stats(&bridge_stats);
+		if (bridge_stats.sent) {
+			printk("main: DIN->USB %u sent %u/wakeup latency avg "
+			       "%u us max %u us dropped %u errors %u\n",
+			       bridge_stats.sent,
+			       bridge_stats.sent / bridge_stats.wakeups,
+			       bridge_stats.latency_sum_us / bridge_stats.sent,
+			       bridge_stats.latency_max_us,
+			       bridge_stats.dropped,
+			       bridge_stats.send_errors);
+		}
+#endif
+		struct midi1_clock_cntr_stats clock_stats;
+
+		midi1_clock_cntr_get_stats(&clock_stats);
+		if (clock_stats.sends) {
+			/* Emission jitter is the spread of the interval */
+			printk("main: clock %u sent latency avg %u us max %u us "
+			       "interval %u..%u ticks dropped %u errors %u\n",
+			       clock_stats.clocks,
+			       clock_stats.latency_sum_us / clock_stats.sends,
+			       clock_stats.latency_max_us,
+			       clock_stats.interval_min_ticks,
+			       clock_stats.interval_max_ticks,
+			       clock_stats.dropped,
+			       clock_stats.send_errors);
+		}
+		if (clock_stats.ramp_cycles_max) {
+			printk("main: clock ramp worst case %u cycles/clock\n",
+			       clock_stats.ramp_cycles_max);
+		}
+		printk("main: transport %u song position %u\n",
+		       midi1_transport_get_state(),
+		       midi1_transport_song_position());
 		
 		
 		/* Half a minute of correct phase */
 		for (int i = 0; i < 3; i++) {
 			
 			printk("main: -- in PHASE -- \n");
-			/* Start the clock with the correct ticks */
+			/* Follow the PLL, takes effect at the next clock */
 			uint32_t pll_ticks = midi1_pll_ticks_get_interval_ticks();
-			midi1_clock_cntr_ticks_start(pll_ticks);
+			midi1_clock_cntr_update_ticks(pll_ticks);
 			k_msleep(10000);
 		}
 #if 0
@@ -6,7 +6,6 @@
  * @updated 20241224
  * @license SPDX-License-Identifier: Apache-2.0
  */
-#include <stdio.h>
 #include <zephyr/audio/midi.h>
 #include "midi1.h"
 
@@ -98,6 +97,14 @@ struct midi_ump midi1_pitchwheel(uint8_t channel, uint16_t val)
 				       (val >> 7) & MIDI_DATA);
 }
 
+struct midi_ump midi1_programchange(uint8_t channel, uint8_t program)
+{
+	return UMP_MIDI1_CHANNEL_VOICE(UMP_CHANNEL_GROUP,
+				       UMP_MIDI_PROGRAM_CHANGE,
+				       channel & 0x0F,
+				       program & MIDI_DATA, 0);
+}
+
 /**
  * -- == System realtime messages == --
  */
@@ -141,132 +148,22 @@ struct midi_ump midi1_reset(void)
 	return UMP_SYS_RT_COMMON(UMP_CHANNEL_GROUP, RT_RESET, 0, 0);
 }
 
-/*
- *------------------------------------------------------------------------------
- * MIDI tempo helpers.
- *
- * upscaled implementation (s)bpm given
- * 1.00 bpm is 100
- * 123.10 bpm is 123100 max 65535 == 655.35 bpm
- * period returned is in microseconds as a uint32_t
- * 0.003814755 3.814 ms --> 3814 us (655,35 bpm)
- * 2.500000000 s/(1/24 qn) --> 2500000 us
- * i.e. multiplied by 1000000
- * Done so we can run it on a ARM M0+ without a FPU and the need
- * to compile in single precision math.
- * By Jan-Willem Smaal <usenet@gispen.org> 20251214
- *
- * Because microseconds is a bit too course for timing some of these
- * calculations will be slightly off.
- *
- * It's better to use clock ticks.  so the spbm_to_ticks 
- */
-
-uint32_t sbpm_to_us_interval(uint16_t sbpm)
+/* Song position pointer, in sixteenth notes since the start */
+struct midi_ump midi1_song_position(uint16_t sixteenths)
 {
-	if (sbpm == 0) {
-		return 0u;
-	} else {
-		uint64_t numer = (uint64_t) US_PER_SECOND * 60u * BPM_SCALE;
-		//uint64_t res = (numer + (sbpm / 2u)) / (uint64_t) sbpm;
-		// Removed rounding due to double rounding  
-		uint64_t res = numer  / (uint64_t) sbpm;
-		return (uint32_t) res;
-	}
+	return UMP_SYS_RT_COMMON(UMP_CHANNEL_GROUP, SYSTEM_SONG_POSITION,
+				 sixteenths & MIDI_DATA,
+				 (sixteenths >> 7) & MIDI_DATA);
 }
 
-
-/* 
- * Formula:
- * ticks_per_pulse = (clock_hz * 60 * BPM_SCALE) / (24 * sbpm)
- *
- * BPM_SCALE = 100 (scaled BPM format)
- * 60 / 24 = 2.5 → multiply by 5, divide by 2
- *
- * keep everything in 64-bit to avoid overflow.
+/*
+ * Any system common (F1..F6) or realtime status as received, e.g. from
+ * a DIN port.  Unused data bytes must be 0.
  */
-uint32_t sbpm_to_ticks(uint16_t sbpm, uint32_t clock_hz)
-{
-	if (sbpm == 0 || clock_hz == 0) {
-		return 0u;
-	}
-
-	
-	const uint64_t numer = (uint64_t)clock_hz * 5ULL * 100ULL;
-	const uint64_t denom = (uint64_t)sbpm * 2ULL;
-
-	/* Rounded division */
-	uint64_t ticks = (numer + (denom / 2ULL)) / denom;
-
-	return (uint32_t)ticks;
-}
-
-uint16_t us_interval_to_sbpm(uint32_t interval)
-{
-	if (interval == 0) {
-		return 0u;
-	} else {
-		uint64_t numer = (uint64_t) US_PER_SECOND * 60u * BPM_SCALE;
-		uint64_t res = (numer + (interval / 2u)) / (uint64_t) interval;
-		return (uint32_t) res;
-	}
-}
-
-uint32_t us_interval_to_24pqn(uint32_t interval)
-{
-	if (interval == 0) {
-		return 0u;
-	} else {
-		return (interval + 12u) / 24u;
-	}
-}
-
-uint32_t pqn24_to_us_interval(uint32_t pqn24)
-{
-	if (pqn24 == 0) {
-		return 0u;
-	} else {
-		return (pqn24 * 24u) + 12u;
-	}
-}
-
-uint32_t sbpm_to_24pqn(uint16_t sbpm)
-{
-	if (sbpm == 0) {
-		return 0u;
-	} else {
-		return us_interval_to_24pqn(sbpm_to_us_interval(sbpm));
-	}
-}
-
-uint16_t pqn24_to_sbpm(uint32_t pqn24)
-{
-	if (pqn24 == 0u) {
-		return 0u;
-	}
-	
-	/* pqn24 = microseconds per tick
-	 * quarter-note interval = pqn24 * 24
-	 * SBPM = (60,000,000 * 100) / quarter-note interval
-	 */
-	uint32_t qn_interval_us = pqn24 * 24u;
-	return us_interval_to_sbpm(qn_interval_us);
-}
-
-
-const char *sbpm_to_str(uint16_t sbpm)
+struct midi_ump midi1_system_message(uint8_t status, uint8_t d1, uint8_t d2)
 {
-	/* Enough for "12345.67" + null */
-	static char buf[16];
-	
-	uint32_t whole = sbpm / 100u;   /* integer BPM */
-	uint32_t frac  = sbpm % 100u;   /* fractional part */
-	
-	/* Format:  whole.frac  (e.g. 120.00) */
-	snprintf(buf, sizeof(buf), "%u.%02u", whole, frac);
-	
-	return buf;
+	return UMP_SYS_RT_COMMON(UMP_CHANNEL_GROUP, status,
+				 d1 & MIDI_DATA, d2 & MIDI_DATA);
 }
 
-/* -------------------------------------------------------------------------- */
 /* EOF */
@@ -0,0 +1,225 @@
+/**
+ * @file midi1_bridge.c
+ * @brief DIN <-> USB bridge, see midi1_bridge.h
+ *
+ * @note
+ * The parser thread must never wait for USB, so the listener only
+ * encodes and queues (K_NO_WAIT, a full queue counts as dropped).  The
+ * sender thread blocks on the queue and sends the whole backlog per
+ * wakeup.  The USB to DIN direction works the same way around, the USB
+ * callback queues and the DIN sender thread is the one that may wait
+ * for room in the UART TX queue.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/usb/class/usbd_midi2.h>
+
+#include "midi1.h"
+#include "midi1_serial.h"
+#include "midi1_clock_measure_counter.h"
+#include "midi1_clock_counter.h"
+#include "midi1_bridge.h"
+
+/* A packet and the UART ISR timestamp of the message it carries */
+struct midi1_bridge_item {
+	struct midi_ump ump;
+	uint32_t timestamp;
+};
+
+K_MSGQ_DEFINE(midi1_bridge_msgq, sizeof(struct midi1_bridge_item),
+	      MIDI1_BRIDGE_QUEUE_SIZE, 4);
+
+K_MSGQ_DEFINE(midi1_bridge_din_msgq, sizeof(struct midi1_bridge_item),
+	      MIDI1_BRIDGE_DIN_QUEUE_SIZE, 4);
+
+static const struct device *g_usb_midi;
+static struct serial_midi_listener g_listeners[SERIAL_MIDI_MAX_PORTS];
+static struct midi1_bridge_stats g_stats;
+static struct midi1_bridge_din_stats g_din_stats;
+
+/*
+ * Clock and transport received on DIN, while the generator clocks the
+ * USB group itself.  Bridged as well the host would get two clocks.
+ */
+static bool midi1_bridge_generated(const struct serial_midi_event *ev)
+{
+	const struct midi1_clock_out *out = midi1_clock_cntr_usb_out();
+
+	switch (ev->status) {
+	case RT_TIMING_CLOCK:
+	case RT_START:
+	case RT_CONTINUE:
+	case RT_STOP:
+	case SYSTEM_SONG_POSITION:
+		return out != NULL && out->enabled;
+	default:
+		return false;
+	}
+}
+
+/* Encode one DIN event, false for the ones that are not bridged */
+static bool midi1_bridge_encode(const struct serial_midi_event *ev,
+				struct midi_ump *ump)
+{
+	uint8_t channel = serial_midi_event_channel(ev);
+
+	switch (ev->type) {
+	case SERIAL_MIDI_EV_NOTE_OFF:
+		*ump = midi1_note_off(channel, ev->data1, ev->data2);
+		break;
+	case SERIAL_MIDI_EV_NOTE_ON:
+		*ump = midi1_note_on(channel, ev->data1, ev->data2);
+		break;
+	case SERIAL_MIDI_EV_POLY_AFTERTOUCH:
+		*ump = midi1_polyaftertouch(channel, ev->data1, ev->data2);
+		break;
+	case SERIAL_MIDI_EV_CONTROL_CHANGE:
+		*ump = midi1_controlchange(channel, ev->data1, ev->data2);
+		break;
+	case SERIAL_MIDI_EV_PROGRAM_CHANGE:
+		*ump = midi1_programchange(channel, ev->data1);
+		break;
+	case SERIAL_MIDI_EV_CHANNEL_AFTERTOUCH:
+		*ump = midi1_channelaftertouch(channel, ev->data1);
+		break;
+	case SERIAL_MIDI_EV_PITCH_WHEEL:
+		*ump = midi1_pitchwheel(channel,
+					(ev->data2 << 7) | ev->data1);
+		break;
+	case SERIAL_MIDI_EV_SYSTEM_COMMON:
+	case SERIAL_MIDI_EV_REALTIME:
+		if (midi1_bridge_generated(ev)) {
+			g_stats.generated++;
+			return false;
+		}
+		*ump = midi1_system_message(ev->status, ev->data1, ev->data2);
+		break;
+	default:
+		return false;
+	}
+	return true;
+}
+
+/* Batched DIN listener, runs in the serial parser thread */
+static void midi1_bridge_listener(uint8_t port,
+				  const struct serial_midi_event *events,
+				  size_t count, void *user_data)
+{
+	struct midi1_bridge_item item;
+
+	for (size_t i = 0; i < count; i++) {
+		if (!midi1_bridge_encode(&events[i], &item.ump)) {
+			continue;
+		}
+		item.timestamp = events[i].timestamp;
+		if (k_msgq_put(&midi1_bridge_msgq, &item, K_NO_WAIT) != 0) {
+			g_stats.dropped++;
+		}
+	}
+}
+
+void midi1_bridge_init(const struct device *usb_midi)
+{
+	g_usb_midi = usb_midi;
+
+	for (uint8_t port = 0; port < SerialMidiNumPorts(); port++) {
+		g_listeners[port].fn = midi1_bridge_listener;
+		g_listeners[port].type_mask = SERIAL_MIDI_EV_ALL;
+		g_listeners[port].batched = true;
+		SerialMidiAddListener(port, &g_listeners[port]);
+	}
+}
+
+void midi1_bridge_usb_sender(void)
+{
+	struct midi1_bridge_item item;
+	uint32_t latency_us;
+	int n = 0;
+
+	if (k_msgq_get(&midi1_bridge_msgq, &item, K_FOREVER) != 0) {
+		return;
+	}
+	g_stats.wakeups++;
+
+	do {
+		if (usbd_midi_send(g_usb_midi, item.ump) != 0) {
+			g_stats.send_errors++;
+			continue;
+		}
+		latency_us = midi1_clock_meas_cntr_since_us(item.timestamp);
+		g_stats.sent++;
+		g_stats.latency_sum_us += latency_us;
+		if (latency_us > g_stats.latency_max_us) {
+			g_stats.latency_max_us = latency_us;
+		}
+	} while (++n < MIDI1_BRIDGE_BATCH &&
+		 k_msgq_get(&midi1_bridge_msgq, &item, K_NO_WAIT) == 0);
+}
+
+void midi1_bridge_get_stats(struct midi1_bridge_stats *stats)
+{
+	*stats = g_stats;
+}
+
+/* ---------------------------- USB to DIN ---------------------------- */
+
+int midi1_bridge_usb_packet(const struct midi_ump *ump)
+{
+	struct midi1_bridge_item item;
+
+	g_din_stats.received++;
+	switch (UMP_MT(*ump)) {
+	case UMP_MT_MIDI1_CHANNEL_VOICE:
+	case UMP_MT_SYS_RT_COMMON:
+		break;
+	default:
+		g_din_stats.ignored++;
+		return -ENOTSUP;
+	}
+	item.ump = *ump;
+	item.timestamp = midi1_clock_meas_cntr_now();
+	if (k_msgq_put(&midi1_bridge_din_msgq, &item, K_NO_WAIT) != 0) {
+		g_din_stats.dropped++;
+		return -ENOMEM;
+	}
+	return 0;
+}
+
+void midi1_bridge_din_sender(void)
+{
+	struct midi1_bridge_item item;
+	uint32_t latency_us;
+	uint8_t status;
+
+	if (k_msgq_get(&midi1_bridge_din_msgq, &item, K_FOREVER) != 0) {
+		return;
+	}
+
+	/*
+	 * The UMP status byte is the MIDI1.0 status byte, channel included
+	 * for channel voice.  Running status is done by the DIN TX path.
+	 */
+	status = UMP_MIDI_STATUS(item.ump);
+	if (SerialMidiSendMessage(MIDI1_BRIDGE_DIN_PORT, status,
+				  UMP_MIDI1_P1(item.ump),
+				  UMP_MIDI1_P2(item.ump)) != 0) {
+		g_din_stats.send_errors++;
+		return;
+	}
+	latency_us = midi1_clock_meas_cntr_since_us(item.timestamp);
+	g_din_stats.sent++;
+	g_din_stats.latency_sum_us += latency_us;
+	if (latency_us > g_din_stats.latency_max_us) {
+		g_din_stats.latency_max_us = latency_us;
+	}
+}
+
+void midi1_bridge_get_din_stats(struct midi1_bridge_din_stats *stats)
+{
+	*stats = g_din_stats;
+}
+
+/* EOF */
@@ -0,0 +1,149 @@
+/**
+ * @file midi1_bridge.h
+ * @brief DIN <-> USB bridge, MIDI1.0 received on the DIN ports is sent
+ * to the USB-MIDI device as UMP and the other way around.
+ *
+ * @note
+ * The bridge is a batched listener on every DIN port
+ * (midi1_serial.h).  It encodes the events with the midi1_* encoders
+ * from midi1.h and puts them in a queue.  A sender thread calling
+ * midi1_bridge_usb_sender() in a loop takes everything that is queued
+ * per wakeup and hands it to usbd_midi_send().  Latency is measured
+ * from the UART ISR timestamp of the event to the USB submission.
+ * While the clock generator's USB output is enabled the DIN clock and
+ * transport are not bridged, the host would get two clocks.
+ *
+ * The other way the USB receive callback hands MIDI1 channel voice and
+ * system/realtime UMPs to midi1_bridge_usb_packet(), which only queues
+ * them.  A DIN sender thread calling midi1_bridge_din_sender() in a loop
+ * writes them with the midi1_serial.c TX path (running status,
+ * coalescing, realtime lane) so the USB stack never waits for the UART.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_BRIDGE_H
+#define MIDI1_BRIDGE_H
+
+#include <stdint.h>
+#include <zephyr/device.h>
+#include <zephyr/audio/midi.h>
+
+/**
+ * @note packets that can wait for the USB sender, 20 bytes each
+ */
+#ifndef MIDI1_BRIDGE_QUEUE_SIZE
+#define MIDI1_BRIDGE_QUEUE_SIZE 64
+#endif
+
+/**
+ * @note most packets sent per sender wakeup
+ */
+#ifndef MIDI1_BRIDGE_BATCH
+#define MIDI1_BRIDGE_BATCH 16
+#endif
+
+/**
+ * @note USB packets that can wait for the DIN sender, at 31250 baud
+ * 64 messages with running status is ~40 ms
+ */
+#ifndef MIDI1_BRIDGE_DIN_QUEUE_SIZE
+#define MIDI1_BRIDGE_DIN_QUEUE_SIZE 64
+#endif
+
+/**
+ * @note DIN port the USB traffic goes to
+ */
+#ifndef MIDI1_BRIDGE_DIN_PORT
+#define MIDI1_BRIDGE_DIN_PORT 0
+#endif
+
+/**
+ * @brief Bridge counters
+ */
+struct midi1_bridge_stats {
+	/* Packets handed to usbd_midi_send() */
+	uint32_t sent;
+	/* Packets lost because the queue was full */
+	uint32_t dropped;
+	/*
+	 * DIN clock, Start/Continue/Stop and song position left out, the
+	 * clock generator sends its own on the USB group
+	 */
+	uint32_t generated;
+	/* usbd_midi_send() errors, e.g. USB not configured */
+	uint32_t send_errors;
+	/* Sender wakeups, sent / wakeups is the batch size */
+	uint32_t wakeups;
+	/* UART ISR to USB submission latency */
+	uint32_t latency_sum_us;
+	uint32_t latency_max_us;
+};
+
+/**
+ * @brief USB to DIN counters.  Bytes per message on the wire are in the
+ * tx_bytes of SerialMidiGetStats() divided by 'sent'.
+ */
+struct midi1_bridge_din_stats {
+	/* UMPs taken from the USB receive callback */
+	uint32_t received;
+	/* Messages handed to the DIN TX path */
+	uint32_t sent;
+	/* UMPs lost because the queue was full */
+	uint32_t dropped;
+	/* UMPs of a type that has no MIDI1.0 byte form */
+	uint32_t ignored;
+	/* DIN TX path errors (queue full with a drop policy) */
+	uint32_t send_errors;
+	/*
+	 * USB receive callback to DIN TX queue.  The wait in the DIN TX
+	 * queue itself is in tx_delay_p* of SerialMidiGetStats().
+	 */
+	uint32_t latency_sum_us;
+	uint32_t latency_max_us;
+};
+
+/**
+ * @brief Start bridging all DIN ports to the USB-MIDI device.
+ *
+ * @note Call after SerialMidiInit() of the ports.
+ * @param usb_midi the USB-MIDI device
+ */
+void midi1_bridge_init(const struct device *usb_midi);
+
+/**
+ * @brief Blocks until packets are queued and sends them to USB.
+ *
+ * @note Call this in a loop from the USB sender thread.
+ */
+void midi1_bridge_usb_sender(void);
+
+/**
+ * @brief Copy of the bridge counters.
+ */
+void midi1_bridge_get_stats(struct midi1_bridge_stats *stats);
+
+/**
+ * @brief Queue a UMP received from USB for the DIN port.
+ *
+ * @note Never blocks, call it from the USB receive callback.
+ * @return 0, -ENOTSUP for UMPs that are not bridged, -ENOMEM when the
+ * queue is full
+ */
+int midi1_bridge_usb_packet(const struct midi_ump *ump);
+
+/**
+ * @brief Blocks until USB packets are queued and writes them to DIN.
+ *
+ * @note Call this in a loop from the DIN sender thread.
+ */
+void midi1_bridge_din_sender(void);
+
+/**
+ * @brief Copy of the USB to DIN counters.
+ */
+void midi1_bridge_get_din_stats(struct midi1_bridge_din_stats *stats);
+
+#endif /* MIDI1_BRIDGE_H */
+/* EOF */
@@ -4,6 +4,19 @@
  * this is a _hardware_ based counter PIT0 channel 0
  * tested with NXP FRDM_MCXC242 in zephyr.
  *
+ * @note
+ * The counter ISR does not send anything itself.  It takes a timestamp
+ * from the measurement counter and puts it in a small single producer
+ * single consumer ring, midi1_clock_cntr_sender() in a high priority
+ * thread does the USB (and DIN) sends.  That keeps the ISR short and
+ * the USB stack locks out of interrupt context, the timestamp still
+ * says when the clock was due.
+ *
+ * The counter runs at MIDI1_CLOCK_CNTR_PPQN and every tick goes through
+ * midi1_clock_fanout.h, which says which outputs are due.  The periods
+ * of the 24 PPQN tempo calls are split over MIDI1_CLOCK_CNTR_SUBDIV
+ * ticks with the fractional accumulator, so they still add up exactly.
+ *
  * @author Jan-Willem Smaal <usenet@gispen.org
  * @date 20251214
  * @license SPDX-License-Identifier: Apache-2.0
@@ -24,7 +37,7 @@
 #if MIDI_CLOCK_ON_PIN
 /*
  * To measure MIDI clock externally we toggle a PIN and measure with
- * the oscilloscope
+ * the oscilloscope, it is a fan-out output like the others.
  */
 #include <zephyr/drivers/gpio.h>
 #endif 
@@ -33,14 +46,109 @@
 /* MIDI helpers by J-W Smaal*/
 #include "midi1.h"
 #include "midi1_clock_counter.h"
+#include "midi1_clock_measure_counter.h"
+#include "midi1_clock_dds.h"
+#include "midi1_clock_ramp.h"
+#include "midi1_clock_fanout.h"
+#include "midi1_clock_groove.h"
+#include "midi1_transport.h"
+#include "midi1_serial.h"
+
+/*
+ * On the NXP PIT (FRDM_MCXC242, FRDM_K64F) the reload register LDVAL of
+ * a running channel is only loaded when the count reaches 0, writing it
+ * changes the tempo at the next clock without touching the phase.  The
+ * counter API can not do that, it stops and restarts the channel.
+ */
+#define MIDI1_CLOCK_CNTR_NODE DT_NODELABEL(COUNTER_DEVICE)
+#if DT_NODE_HAS_COMPAT(DT_PARENT(MIDI1_CLOCK_CNTR_NODE), nxp_pit)
+#include <fsl_pit.h>
+#define MIDI1_CLOCK_CNTR_PIT 1
+#define MIDI1_CLOCK_CNTR_PIT_BASE \
+	((PIT_Type *)DT_REG_ADDR(DT_PARENT(MIDI1_CLOCK_CNTR_NODE)))
+#define MIDI1_CLOCK_CNTR_PIT_CHANNEL \
+	((pit_chnl_t)DT_REG_ADDR(MIDI1_CLOCK_CNTR_NODE))
+#else
+#define MIDI1_CLOCK_CNTR_PIT 0
+#endif
+
+BUILD_ASSERT((MIDI1_CLOCK_CNTR_QUEUE_SIZE & (MIDI1_CLOCK_CNTR_QUEUE_SIZE - 1)) == 0,
+	     "MIDI1_CLOCK_CNTR_QUEUE_SIZE must be a power of 2");
+BUILD_ASSERT((MIDI1_CLOCK_CNTR_SUBDIV & (MIDI1_CLOCK_CNTR_SUBDIV - 1)) == 0,
+	     "MIDI1_CLOCK_CNTR_SUBDIV must be a power of 2");
 
 static atomic_t g_midi1_running_cntr = ATOMIC_INIT(0);
 static uint16_t g_sbpm = 0;
 static const struct device *g_midi1_dev;
 const struct device *g_counter_dev;
 
+/* A master tick with USB or DIN outputs due, or a transport message */
+struct midi1_clock_cntr_tick {
+	uint32_t timestamp;
+	uint32_t due;		/* midi1_clock_fanout_tick() */
+	uint8_t transport;	/* midi1_transport_clock() */
+	uint16_t sixteenths;	/* song position for RT_CONTINUE */
+};
+
+/*
+ * Clock emission timestamps, the ISR only writes g_clock_in and the
+ * sender thread only g_clock_out.  Both run free, the difference is the
+ * fill level.
+ */
+static struct midi1_clock_cntr_tick g_clock_ts[MIDI1_CLOCK_CNTR_QUEUE_SIZE];
+static uint32_t g_clock_in;
+static uint32_t g_clock_out;
+K_SEM_DEFINE(midi1_clock_cntr_sem, 0, 1);
+
+static struct midi1_clock_cntr_stats g_stats;
+/*
+ * Period of the generated clock with its fractional tick.  Only used on
+ * the PIT, the ISR writes the next period to the reload register so
+ * it applies one clock later.  The lock keeps a tempo change from a
+ * thread and the ISR apart.
+ */
+static struct midi1_clock_dds g_dds;
+static struct k_spinlock g_dds_lock;
+
+/*
+ * Tempo ramp, when it runs it gives the periods instead of g_dds.
+ * g_dds_target is the exact target tempo, it takes over at the end.
+ */
+static struct midi1_clock_ramp g_ramp;
+static struct midi1_clock_dds g_dds_target;
+static uint16_t g_ramp_sbpm;
+
+/*
+ * Swing, only on the PIT like the fraction.  The ISR reads one table,
+ * a thread computes the other one and hands it over as pending.
+ * g_groove_adjust is what the period in the reload register got.
+ */
+static struct midi1_clock_groove g_groove = {
+	.subdiv = MIDI1_CLOCK_CNTR_SUBDIV,
+};
+static struct midi1_clock_groove_table g_groove_tables[2];
+static int32_t g_groove_adjust;
+static uint8_t g_swing = MIDI1_CLOCK_GROOVE_STRAIGHT;
+static uint8_t g_swing_note = MIDI1_CLOCK_GROOVE_16TH;
+
+/* Cleared on start/stop so the gap is not counted as an interval */
+static bool g_prev_valid;
+static uint32_t g_prev_ts;
+
 
 
+/*
+ * Default outputs, the USB one is output 0: the reference for the
+ * interval stats.
+ */
+static struct midi1_clock_out g_usb_out = {
+	.type = MIDI1_CLOCK_OUT_USB,
+	.index = UMP_CHANNEL_GROUP,
+	.divider = MIDI1_CLOCK_DIV_24PPQN,
+	.enabled = true,
+};
+static struct midi1_clock_out g_din_out[SERIAL_MIDI_MAX_PORTS];
+
 /*
  * MIDI clock measurement on a PIN.
  * I used PTC8 on the FRDM_MCXC242 scope confirms correct implementation.  
@@ -49,32 +157,273 @@ const struct device *g_counter_dev;
 #define CLOCK_FREQ_OUT DT_NODELABEL(freq_out)
 static const struct gpio_dt_spec clock_pin = GPIO_DT_SPEC_GET(CLOCK_FREQ_OUT, gpios);
 
-static void midi1_debug_gpio_init(void)
+/* Toggles on every 24 PPQN clock */
+static struct midi1_clock_out g_pin_out = {
+	.type = MIDI1_CLOCK_OUT_GPIO,
+	.gpio = &clock_pin,
+	.divider = MIDI1_CLOCK_DIV_24PPQN,
+	.enabled = true,
+};
+#endif 
+
+static void midi1_cntr_handler(const struct device *dev, void *midi1_dev_arg);
+
+/*
+ * Write a period to the running counter, it takes effect at the next
+ * clock.  On the PIT called with g_dds_lock held, the ISR writes the
+ * reload register too.  Other counters go through the driver, that is
+ * never called with the spinlock held.
+ */
+static void midi1_clock_cntr_set_period(uint32_t ticks)
+{
+#if MIDI1_CLOCK_CNTR_PIT
+	/* Same period convention as the counter driver's set_top_value */
+	PIT_SetTimerPeriod(MIDI1_CLOCK_CNTR_PIT_BASE,
+			   MIDI1_CLOCK_CNTR_PIT_CHANNEL, ticks);
+#else
+	struct counter_top_cfg top_cfg = {
+		.callback = midi1_cntr_handler,
+		.user_data = (void *)g_midi1_dev,
+		.ticks = ticks,
+		.flags = COUNTER_TOP_CFG_DONT_RESET,   /* <-- KEY */
+	};
+	
+	int err = counter_set_top_value(g_counter_dev, &top_cfg);
+	if (err != 0) {
+		printk("Failed to set top value: %d\n", err);
+		return;
+	}
+#endif
+}
+
+/*
+ * Period with a swing adjustment.  After a big tempo jump the table of
+ * the old tempo is used until the next beat, the period must stay a
+ * period.
+ */
+static uint32_t midi1_clock_cntr_swung(uint32_t period, int32_t adjust)
 {
-	int ret = gpio_pin_configure_dt(&clock_pin, GPIO_OUTPUT_INACTIVE); 
-	if (ret < 0){
-		printk("Error configing pin\n");
-		return; 
+	if (adjust < -(int32_t)(period / 2)) {
+		adjust = -(int32_t)(period / 2);
 	}
+	return period + adjust;
 }
-#endif 
+
+/*
+ * New swing table for the tempo and swing now, it takes over at the
+ * next beat.  Not from the ISR, this is where the divides are.
+ */
+static void midi1_clock_cntr_groove_update(void)
+{
+	struct midi1_clock_groove_table *table;
+	k_spinlock_key_t key;
+	uint32_t pulse_ticks;
+
+	if (g_swing == MIDI1_CLOCK_GROOVE_STRAIGHT) {
+		return;
+	}
+	key = k_spin_lock(&g_dds_lock);
+	/* Not pending any more, so the ISR can not pick it up half done */
+	g_groove.pending = NULL;
+	table = (g_groove.table == &g_groove_tables[0]) ?
+		&g_groove_tables[1] : &g_groove_tables[0];
+	pulse_ticks = g_dds.ticks * MIDI1_CLOCK_CNTR_SUBDIV +
+		      (uint32_t)((uint64_t)g_dds.frac * MIDI1_CLOCK_CNTR_SUBDIV /
+				 g_dds.denom);
+	k_spin_unlock(&g_dds_lock, key);
+
+	midi1_clock_groove_table_swing(table, g_swing, g_swing_note,
+				       pulse_ticks, MIDI1_CLOCK_CNTR_SUBDIV);
+
+	key = k_spin_lock(&g_dds_lock);
+	midi1_clock_groove_set(&g_groove, table);
+	k_spin_unlock(&g_dds_lock, key);
+}
+
+#if MIDI1_CLOCK_CNTR_PIT
+/*
+ * Next period with the swing of its pulse.  Called with g_dds_lock
+ * held.
+ */
+static uint32_t midi1_clock_cntr_next_period(void)
+{
+	uint32_t period = midi1_clock_dds_next(&g_dds);
+
+	g_groove_adjust = midi1_clock_groove_next(&g_groove);
+	return midi1_clock_cntr_swung(period, g_groove_adjust);
+}
+
+/*
+ * Next period of a ramp, from the ISR.  The cycles spent here are what
+ * a ramp adds per clock, the worst case goes in the stats.
+ */
+static void midi1_clock_cntr_ramp_step(void)
+{
+	uint32_t start = k_cycle_get_32();
+	k_spinlock_key_t key = k_spin_lock(&g_dds_lock);
+	uint32_t period = midi1_clock_ramp_next(&g_ramp);
+	uint32_t cycles;
+
+	/* No swing during a ramp, but the beat goes on */
+	midi1_clock_groove_next(&g_groove);
+	if (period == 0) {
+		/* Cancelled since the caller looked */
+		k_spin_unlock(&g_dds_lock, key);
+		return;
+	}
+	midi1_clock_cntr_set_period(period);
+	if (!midi1_clock_ramp_active(&g_ramp)) {
+		/* Done, the exact target tempo carries on */
+		g_dds = g_dds_target;
+		g_sbpm = g_ramp_sbpm;
+	}
+	k_spin_unlock(&g_dds_lock, key);
+
+	cycles = k_cycle_get_32() - start;
+	if (cycles > g_stats.ramp_cycles_max) {
+		g_stats.ramp_cycles_max = cycles;
+	}
+}
+#endif
 
 /* 
- * This is the ISR/callback TODO: check if usbd_midi_send is non-blocking 
+ * This is the ISR/callback, it only timestamps and queues.  The send
+ * happens in midi1_clock_cntr_sender().
  */ 
 static void midi1_cntr_handler(const struct device *dev, void *midi1_dev_arg)
 {
-#if MIDI_CLOCK_ON_PIN
-	gpio_pin_toggle_dt(&clock_pin);
+	uint32_t now = midi1_clock_meas_cntr_now();
+	uint16_t sixteenths = 0;
+	uint8_t transport = 0;
+	bool clock;
+	uint32_t due;
+
+#if MIDI1_CLOCK_CNTR_PIT
+	if (midi1_clock_ramp_active(&g_ramp)) {
+		midi1_clock_cntr_ramp_step();
+	} else if (g_dds.frac != 0 || midi1_clock_groove_active(&g_groove)) {
+		/*
+		 * N or N+1 ticks, plus the swing, for the period after the
+		 * one that started
+		 */
+		k_spinlock_key_t key = k_spin_lock(&g_dds_lock);
+
+		midi1_clock_cntr_set_period(midi1_clock_cntr_next_period());
+		k_spin_unlock(&g_dds_lock, key);
+	} else {
+		/* Whole ticks, nothing to write, the groove keeps the beat */
+		k_spinlock_key_t key = k_spin_lock(&g_dds_lock);
+
+		midi1_clock_groove_next(&g_groove);
+		k_spin_unlock(&g_dds_lock, key);
+	}
 #endif
 
 	if (!atomic_get(&g_midi1_running_cntr)) {
 		return;
 	}
-	if (g_midi1_dev) {
-		usbd_midi_send(g_midi1_dev, midi1_timing_clock());
+	/* A 24 PPQN clock every MIDI1_CLOCK_CNTR_SUBDIV master ticks */
+	clock = (midi1_clock_fanout_ticks() &
+		 (MIDI1_CLOCK_CNTR_SUBDIV - 1)) == 0;
+	/* GPIO outputs are done in there, only the sends are queued */
+	due = midi1_clock_fanout_tick();
+	if (clock) {
+		transport = midi1_transport_clock(&sixteenths);
+	}
+	if (transport == RT_START || transport == RT_CONTINUE) {
+		/*
+		 * The song starts on the next clock, the swing goes with it.
+		 * This ISR already wrote the period after this one.
+		 */
+		midi1_clock_groove_seek(&g_groove, (sixteenths & 3) *
+					MIDI1_TRANSPORT_CLOCKS_PER_16TH,
+					MIDI1_CLOCK_CNTR_SUBDIV - 1);
+	}
+	if (due == 0 && transport == 0) {
+		return;
+	}
+	if (g_clock_in - g_clock_out >= MIDI1_CLOCK_CNTR_QUEUE_SIZE) {
+		/* Sender thread is stuck, nothing we can do here */
+		g_stats.dropped++;
+		return;
+	}
+	g_clock_ts[g_clock_in & (MIDI1_CLOCK_CNTR_QUEUE_SIZE - 1)] =
+		(struct midi1_clock_cntr_tick){
+			.timestamp = now,
+			.due = due,
+			.transport = transport,
+			.sixteenths = sixteenths,
+		};
+	g_clock_in++;
+	k_sem_give(&midi1_clock_cntr_sem);
+}
+
+/* Interval between two emissions, the measurement counter counts down */
+static void midi1_clock_cntr_interval(uint32_t ts)
+{
+	uint32_t interval;
+
+	if (g_prev_valid) {
+		interval = g_prev_ts - ts;
+		if (g_stats.interval_min_ticks == 0 ||
+		    interval < g_stats.interval_min_ticks) {
+			g_stats.interval_min_ticks = interval;
+		}
+		if (interval > g_stats.interval_max_ticks) {
+			g_stats.interval_max_ticks = interval;
+		}
+	}
+	g_prev_ts = ts;
+	g_prev_valid = true;
+}
+
+void midi1_clock_cntr_sender(void)
+{
+	struct midi1_clock_cntr_tick tick;
+	uint32_t latency_us;
+
+	if (k_sem_take(&midi1_clock_cntr_sem, K_FOREVER) != 0) {
+		return;
+	}
+
+	while (g_clock_out != g_clock_in) {
+		tick = g_clock_ts[g_clock_out & (MIDI1_CLOCK_CNTR_QUEUE_SIZE - 1)];
+		g_clock_out++;
+
+		/* Stop before the clock, Start and Continue after it */
+		if (tick.transport == RT_STOP) {
+			g_stats.send_errors += midi1_clock_fanout_send_message(
+				RT_STOP, 0, 0, g_midi1_dev);
+		}
+		g_stats.send_errors += midi1_clock_fanout_send(tick.due,
+							       g_midi1_dev);
+		if (tick.transport == RT_CONTINUE) {
+			/* The position first, in order on DIN too */
+			g_stats.send_errors += midi1_clock_fanout_send_continue(
+				tick.sixteenths, g_midi1_dev);
+		}
+		if (tick.transport == RT_START) {
+			g_stats.send_errors += midi1_clock_fanout_send_message(
+				RT_START, 0, 0, g_midi1_dev);
+		}
+		latency_us = midi1_clock_meas_cntr_since_us(tick.timestamp);
+		g_stats.sends++;
+		g_stats.latency_sum_us += latency_us;
+		if (latency_us > g_stats.latency_max_us) {
+			g_stats.latency_max_us = latency_us;
+		}
+		if (!(tick.due & BIT(0))) {
+			continue;
+		}
+		g_stats.clocks++;
+		g_stats.last_timestamp = tick.timestamp;
+		midi1_clock_cntr_interval(tick.timestamp);
 	}
-	return; 
+}
+
+void midi1_clock_cntr_get_stats(struct midi1_clock_cntr_stats *stats)
+{
+	*stats = g_stats;
 }
 
 uint32_t midi1_clock_cntr_cpu_frequency(void) 
@@ -95,24 +444,48 @@ void midi1_clock_cntr_init(const struct device *midi1_dev_arg)
 		return;
 	}
 	g_midi1_dev = midi1_dev_arg;
+
+	/* Adding again is harmless, midi1_clock_cntr_gen() inits too */
+	midi1_clock_fanout_add(&g_usb_out);
+	for (uint8_t port = 0; port < SerialMidiNumPorts(); port++) {
+		g_din_out[port].type = MIDI1_CLOCK_OUT_DIN;
+		g_din_out[port].index = port;
+		g_din_out[port].divider = MIDI1_CLOCK_DIV_24PPQN;
+		g_din_out[port].enabled = MIDI1_CLOCK_CNTR_DIN_OUT;
+		midi1_clock_fanout_add(&g_din_out[port]);
+	}
 #if MIDI_CLOCK_ON_PIN
-	midi1_debug_gpio_init();
+	midi1_clock_fanout_add(&g_pin_out);
 #endif 
 
 	return;
 }
 
+struct midi1_clock_out *midi1_clock_cntr_usb_out(void)
+{
+	return &g_usb_out;
+}
 
-/*
- * Start periodic MIDI clock. ticks must be > 0.
- */
-void midi1_clock_cntr_ticks_start(uint32_t ticks)
+struct midi1_clock_out *midi1_clock_cntr_din_out(uint8_t port)
+{
+	if (port >= SerialMidiNumPorts()) {
+		return NULL;
+	}
+	return &g_din_out[port];
+}
+
+
+/* Set the period of the first clock and (re)start the counter */
+static void midi1_clock_cntr_top_start(uint32_t ticks)
 {
 	int err = 0;
 	if (ticks == 0u) {
 		return;
 	}
+	/* All outputs start together on the first tick */
+	midi1_clock_fanout_reset();
 	atomic_set(&g_midi1_running_cntr, 1);
+	g_prev_valid = false;
 #if MIDI_CLOCK_ON_PIN
 	//printk("Ticks requested: %u\n", ticks);
 #endif
@@ -137,67 +510,204 @@ void midi1_clock_cntr_ticks_start(uint32_t ticks)
 	}
 }
 
-/* TODO: is not working with PIT!! BUG in my thinking */
+/*
+ * Start periodic MIDI clock. ticks must be > 0.
+ */
+void midi1_clock_cntr_ticks_start(uint32_t ticks)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_dds_lock);
+	uint32_t first;
+
+	midi1_clock_ramp_cancel(&g_ramp);
+	midi1_clock_dds_init_div(&g_dds, ticks, MIDI1_CLOCK_CNTR_SUBDIV);
+	midi1_clock_groove_reset(&g_groove);
+	first = midi1_clock_dds_next(&g_dds);
+	k_spin_unlock(&g_dds_lock, key);
+	midi1_clock_cntr_top_start(first);
+#if MIDI1_CLOCK_CNTR_PIT
+	key = k_spin_lock(&g_dds_lock);
+	midi1_clock_cntr_set_period(midi1_clock_cntr_next_period());
+	k_spin_unlock(&g_dds_lock, key);
+#endif
+	midi1_clock_cntr_groove_update();
+}
+
+/*
+ * Write the next period of g_dds, with the swing the reload register
+ * already has, and release g_dds_lock.  See
+ * midi1_clock_cntr_set_period() for which side of the unlock.
+ */
+static void midi1_clock_cntr_update_unlock(k_spinlock_key_t key)
+{
+	uint32_t period = midi1_clock_cntr_swung(midi1_clock_dds_next(&g_dds),
+						 g_groove_adjust);
+
+#if MIDI1_CLOCK_CNTR_PIT
+	midi1_clock_cntr_set_period(period);
+	k_spin_unlock(&g_dds_lock, key);
+#else
+	k_spin_unlock(&g_dds_lock, key);
+	midi1_clock_cntr_set_period(period);
+#endif
+}
+
+/*
+ * Phase continuous tempo change: the period in progress finishes with
+ * the old value, the next one has the new value.
+ */
 void midi1_clock_cntr_update_ticks(uint32_t new_ticks)
 {
-	struct counter_top_cfg top_cfg = {
-		.callback = midi1_cntr_handler,
-		.user_data = (void *)g_midi1_dev,
-		.ticks = new_ticks,
-		.flags = COUNTER_TOP_CFG_DONT_RESET,   /* <-- KEY */
-	};
-	
-	int err = counter_set_top_value(g_counter_dev, &top_cfg);
-	if (err != 0) {
-		printk("Failed to set top value: %d\n", err);
+	k_spinlock_key_t key;
+
+	if (new_ticks == 0u) {
 		return;
 	}
+	key = k_spin_lock(&g_dds_lock);
+	midi1_clock_ramp_cancel(&g_ramp);
+	midi1_clock_dds_init_div(&g_dds, new_ticks, MIDI1_CLOCK_CNTR_SUBDIV);
+	midi1_clock_cntr_update_unlock(key);
+	midi1_clock_cntr_groove_update();
 	//printk("Updating ticks to: %u\n", new_ticks);
 }
 
+/*
+ * Same with the exact tempo, the fraction of a tick is carried from
+ * period to period.
+ */
+void midi1_clock_cntr_update_sbpm(uint16_t sbpm)
+{
+	k_spinlock_key_t key;
+
+	if (sbpm == 0u) {
+		return;
+	}
+	g_sbpm = sbpm;
+	key = k_spin_lock(&g_dds_lock);
+	midi1_clock_ramp_cancel(&g_ramp);
+	midi1_clock_dds_init(&g_dds, sbpm, midi1_clock_cntr_cpu_frequency(),
+			     MIDI1_CLOCK_CNTR_PPQN);
+	midi1_clock_cntr_update_unlock(key);
+	midi1_clock_cntr_groove_update();
+}
+
 /*
  * Start periodic MIDI clock. interval_us must be > 0. 
  */
 void midi1_clock_cntr_start(uint32_t interval_us)
 {
-	int err = 0;
 	if (interval_us == 0u) {
 		return;
 	}
-	atomic_set(&g_midi1_running_cntr, 1);
-
-	uint32_t ticks = counter_us_to_ticks(g_counter_dev, interval_us); 
 	g_sbpm = us_interval_to_sbpm(interval_us);
+	midi1_clock_cntr_ticks_start(counter_us_to_ticks(g_counter_dev,
+							  interval_us));
+}
 
-	/*
-	 * Configure top value when it overflows the midi1_cntr_handler is
-	 * called as an ISR
-	 */
-	struct counter_top_cfg top_cfg = {
-		.callback = midi1_cntr_handler,
-		.user_data = (void *) g_midi1_dev,
-		.ticks = ticks,
-		.flags = 0,
-	};
+int midi1_clock_cntr_ramp(uint16_t sbpm, uint16_t beats,
+			  enum midi1_clock_ramp_curve curve)
+{
+#if MIDI1_CLOCK_CNTR_PIT
+	uint32_t clock_hz = midi1_clock_cntr_cpu_frequency();
+	struct midi1_clock_dds target;
+	k_spinlock_key_t key;
+	uint32_t from;
+
+	if (sbpm == 0u) {
+		return -EINVAL;
+	}
+	if (g_swing != MIDI1_CLOCK_GROOVE_STRAIGHT) {
+		/* A table per clock would be no table */
+		return -EBUSY;
+	}
+	/* The divides are done here, not in the ISR */
+	midi1_clock_dds_init(&target, sbpm, clock_hz, MIDI1_CLOCK_CNTR_PPQN);
+
+	key = k_spin_lock(&g_dds_lock);
+	if (midi1_clock_ramp_active(&g_ramp)) {
+		/* From wherever the running ramp is */
+		from = g_ramp.period;
+	} else {
+		from = g_dds.ticks;
+	}
+	midi1_clock_ramp_start(&g_ramp, from, sbpm,
+			       (uint32_t)beats * MIDI1_CLOCK_CNTR_PPQN, curve,
+			       clock_hz, MIDI1_CLOCK_CNTR_PPQN);
+	g_dds_target = target;
+	g_ramp_sbpm = sbpm;
+	k_spin_unlock(&g_dds_lock, key);
+	return 0;
+#else
+	/* Needs the per clock reload of the PIT, step instead */
+	midi1_clock_cntr_update_sbpm(sbpm);
+	return -ENOTSUP;
+#endif
+}
 
-	err = counter_set_top_value(g_counter_dev, &top_cfg);
-	if (err != 0) {
-		printk("Failed to set top value: %d\n", err);
-		return;
+void midi1_clock_cntr_ramp_cancel(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_dds_lock);
+
+	if (midi1_clock_ramp_active(&g_ramp)) {
+		midi1_clock_ramp_cancel(&g_ramp);
+		/* Hold the period of the last ramp clock */
+		midi1_clock_dds_init_ticks(&g_dds, g_ramp.period);
+		g_sbpm = midi1_clock_ramp_tempo(g_ramp.period,
+						midi1_clock_cntr_cpu_frequency(),
+						MIDI1_CLOCK_CNTR_PPQN) /
+			 MIDI1_CLOCK_RAMP_TEMPO_ONE;
 	}
+	k_spin_unlock(&g_dds_lock, key);
+}
 
-	/* Start the counter */
-	err = counter_start(g_counter_dev);
-	if (err != 0) {
-		printk("Failed to start counter: %d\n", err);
-		return;
+bool midi1_clock_cntr_ramp_active(void)
+{
+	return midi1_clock_ramp_active(&g_ramp);
+}
+
+int midi1_clock_cntr_swing(uint8_t percent, uint8_t note)
+{
+#if MIDI1_CLOCK_CNTR_PIT
+	k_spinlock_key_t key;
+
+	if (percent < MIDI1_CLOCK_GROOVE_STRAIGHT ||
+	    percent > MIDI1_CLOCK_GROOVE_SWING_MAX || note == 0 ||
+	    MIDI1_CLOCK_GROOVE_PULSES % (2 * note) != 0) {
+		return -EINVAL;
 	}
+	if (midi1_clock_ramp_active(&g_ramp)) {
+		return -EBUSY;
+	}
+	g_swing = percent;
+	g_swing_note = note;
+	if (percent == MIDI1_CLOCK_GROOVE_STRAIGHT) {
+		key = k_spin_lock(&g_dds_lock);
+		midi1_clock_groove_set(&g_groove, NULL);
+		k_spin_unlock(&g_dds_lock, key);
+		return 0;
+	}
+	midi1_clock_cntr_groove_update();
+	return 0;
+#else
+	/* Needs the per clock reload of the PIT */
+	return -ENOTSUP;
+#endif
+}
+
+uint8_t midi1_clock_cntr_get_swing(void)
+{
+	return g_swing;
+}
+
+bool midi1_clock_cntr_running(void)
+{
+	return atomic_get(&g_midi1_running_cntr) != 0;
 }
 
 /* Stop the clock */
 void midi1_clock_cntr_stop(void)
 {
 	atomic_set(&g_midi1_running_cntr, 0);
+	g_prev_valid = false;
 }
 
 
@@ -207,22 +717,37 @@ void midi1_clock_cntr_stop(void)
 void midi1_clock_cntr_gen(const struct device *midi_ptr, uint16_t sbpm) {
 	midi1_clock_cntr_stop();
 	midi1_clock_cntr_init(midi_ptr);
-	
-	uint32_t ticks = sbpm_to_ticks(
-				       sbpm,
-				       midi1_clock_cntr_cpu_frequency()
-				       );
-	
-	midi1_clock_cntr_ticks_start(ticks);
+	midi1_clock_cntr_gen_sbpm(sbpm);
 }
 
 
+/*
+ * The first period is started with the counter API, the second one is
+ * written straight away so the accumulator is in step from the start.
+ */
 void midi1_clock_cntr_gen_sbpm(uint16_t sbpm) {
-	uint32_t ticks = sbpm_to_ticks(
-				sbpm,
-				midi1_clock_cntr_cpu_frequency());
-	
-	midi1_clock_cntr_ticks_start(ticks);
+	k_spinlock_key_t key;
+	uint32_t first;
+
+	if (sbpm == 0u) {
+		return;
+	}
+	g_sbpm = sbpm;
+	key = k_spin_lock(&g_dds_lock);
+	midi1_clock_ramp_cancel(&g_ramp);
+	midi1_clock_dds_init(&g_dds, sbpm, midi1_clock_cntr_cpu_frequency(),
+			     MIDI1_CLOCK_CNTR_PPQN);
+	midi1_clock_groove_reset(&g_groove);
+	first = midi1_clock_dds_next(&g_dds);
+	k_spin_unlock(&g_dds_lock, key);
+
+	midi1_clock_cntr_top_start(first);
+#if MIDI1_CLOCK_CNTR_PIT
+	key = k_spin_lock(&g_dds_lock);
+	midi1_clock_cntr_set_period(midi1_clock_cntr_next_period());
+	k_spin_unlock(&g_dds_lock, key);
+#endif
+	midi1_clock_cntr_groove_update();
 }
 
 uint16_t midi1_clock_cntr_get_sbpm() {
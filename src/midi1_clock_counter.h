@@ -13,11 +13,65 @@
 #include <zephyr/sys/atomic.h>	/* atomic_t, atomic_get/set */
 #include <stdint.h>		/* uint32_t, uint16_t */
 #include <stddef.h>		/* NULL */
+#include <stdbool.h>
+
+#include "midi1_clock_ramp.h"
+#include "midi1_clock_fanout.h"
+#include "midi1_clock_groove.h"
 
 #ifndef COUNTER_DEVICE
 #define COUNTER_DEVICE pit0_channel0
 #endif
 
+/**
+ * @note clock ticks that can wait for the sender thread, power of 2
+ */
+#ifndef MIDI1_CLOCK_CNTR_QUEUE_SIZE
+#define MIDI1_CLOCK_CNTR_QUEUE_SIZE 16
+#endif
+
+/**
+ * @note Master ticks per quarter note of the counter, the outputs divide
+ * it down (midi1_clock_fanout.h).  The tick arguments of the functions
+ * below are 24 PPQN MIDI clock periods, split in MIDI1_CLOCK_CNTR_SUBDIV
+ * master ticks.
+ */
+#define MIDI1_CLOCK_CNTR_PPQN MIDI1_CLOCK_FANOUT_PPQN
+#define MIDI1_CLOCK_CNTR_SUBDIV (MIDI1_CLOCK_CNTR_PPQN / 24)
+
+/**
+ * @note the DIN port outputs start enabled
+ */
+#ifndef MIDI1_CLOCK_CNTR_DIN_OUT
+#define MIDI1_CLOCK_CNTR_DIN_OUT 1
+#endif
+
+/**
+ * @brief Clock sender counters.  Timestamps and intervals are in
+ * measurement counter ticks (midi1_clock_measure_counter.h) taken in
+ * the counter ISR, so the interval spread is the emission jitter.
+ */
+struct midi1_clock_cntr_stats {
+	/* Clock ticks sent on output 0, the default USB output */
+	uint32_t clocks;
+	/* Master ticks with any USB or DIN output due */
+	uint32_t sends;
+	/* Ticks lost because the sender thread did not keep up */
+	uint32_t dropped;
+	/* usbd_midi_send() errors, e.g. USB not configured */
+	uint32_t send_errors;
+	/* Counter ISR to USB submission */
+	uint32_t latency_sum_us;
+	uint32_t latency_max_us;
+	/* Between two output 0 ISR timestamps, reset on start/stop */
+	uint32_t interval_min_ticks;
+	uint32_t interval_max_ticks;
+	/* ISR timestamp of the last clock sent */
+	uint32_t last_timestamp;
+	/* Worst case cycles a tempo ramp added to the counter ISR */
+	uint32_t ramp_cycles_max;
+};
+
 /**
  * @brief Initialize MIDI clock subsystem with the MIDI device handle.
  *
@@ -26,6 +80,17 @@
  */
 void midi1_clock_cntr_init(const struct device *midi1_dev);
 
+/**
+ * @brief The default outputs added by midi1_clock_cntr_init(): 24 PPQN
+ * on the USB group UMP_CHANNEL_GROUP and on every DIN port.  Use
+ * midi1_clock_fanout_enable() and midi1_clock_fanout_set_divider() on
+ * them, more outputs can be added with midi1_clock_fanout_add().
+ *
+ * @return the output, NULL for a port that does not exist
+ */
+struct midi1_clock_out *midi1_clock_cntr_usb_out(void);
+struct midi1_clock_out *midi1_clock_cntr_din_out(uint8_t port);
+
 /**
  * @brief getter for the internal counter frequency in MHZ
  *
@@ -49,12 +114,80 @@ void midi1_clock_cntr_start(uint32_t interval_us);
 void midi1_clock_cntr_ticks_start(uint32_t ticks);
 
 /**
- * @brief placeholder for updating the clock
+ * @brief Change the tempo of the running clock without a phase jump.
  *
- * @note this is not supported on PIT0 channel 0 on NXP
+ * @note The period in progress keeps the old length, the new one
+ * starts at the next clock.  On the NXP PIT this writes the reload
+ * register directly, other counters go through counter_set_top_value()
+ * with COUNTER_TOP_CFG_DONT_RESET.
+ * @param new_ticks clock interval in counter ticks, 0 is ignored
  */
 void midi1_clock_cntr_update_ticks(uint32_t new_ticks);
 
+/**
+ * @brief Change the tempo of the running clock without a phase jump,
+ * with the exact tempo instead of a rounded number of ticks.
+ *
+ * @note Periods alternate between N and N+1 ticks so the average is
+ * the requested tempo, see midi1_clock_dds.h.  Only the PIT carries
+ * the fraction, other counters get N.
+ * @param sbpm scaled BPM like 123.12 must be entered like 12312
+ */
+void midi1_clock_cntr_update_sbpm(uint16_t sbpm);
+
+/**
+ * @brief Accelerando/ritardando from the current tempo to sbpm.
+ *
+ * @note Every clock of the ramp gets the period of its own tempo,
+ * computed in the counter ISR, see midi1_clock_ramp.h.  Starting a ramp
+ * while one runs continues from where that one is, any other tempo
+ * change cancels it.  Needs the PIT, other counters step to sbpm.
+ * Not with swing on.
+ * @param sbpm target, scaled BPM like 123.12 must be entered like 12312
+ * @param beats length in quarter notes, 0 is a step on the next clock
+ * @param curve MIDI1_CLOCK_RAMP_LINEAR or MIDI1_CLOCK_RAMP_EXPONENTIAL
+ * @return 0, -EINVAL for sbpm 0, -EBUSY with swing, -ENOTSUP without
+ * the PIT
+ */
+int midi1_clock_cntr_ramp(uint16_t sbpm, uint16_t beats,
+			  enum midi1_clock_ramp_curve curve);
+
+/**
+ * @brief Stop a running ramp, the clock stays at the tempo it reached.
+ */
+void midi1_clock_cntr_ramp_cancel(void);
+
+/**
+ * @brief true while a ramp runs
+ */
+bool midi1_clock_cntr_ramp_active(void);
+
+/**
+ * @brief Swing/shuffle the generated clock.
+ *
+ * @note The reload value of every period gets the offset of its pulse
+ * from a groove table (midi1_clock_groove.h), so all outputs swing the
+ * same and stay in phase.  The table is recomputed on every tempo
+ * change and takes over at the start of the next beat, beat 0 is the
+ * first clock after a start.  Needs the PIT.
+ * @param percent 50 (straight) .. 75
+ * @param note pulses of the swung note, MIDI1_CLOCK_GROOVE_16TH or
+ *             MIDI1_CLOCK_GROOVE_8TH
+ * @return 0, -EINVAL, -EBUSY during a ramp, -ENOTSUP without the PIT
+ */
+int midi1_clock_cntr_swing(uint8_t percent, uint8_t note);
+
+/**
+ * @brief Swing in percent, 50 is straight
+ */
+uint8_t midi1_clock_cntr_get_swing(void);
+
+/**
+ * @brief true while the clock is generated, the transport
+ * (midi1_transport.h) needs it
+ */
+bool midi1_clock_cntr_running(void);
+
 /**
  * @brief Stop the clock
  */
@@ -69,7 +202,8 @@ void midi1_clock_cntr_stop(void);
 void midi1_clock_cntr_gen(const struct device *midi, uint16_t sbpm);
 
 /**
- * @brief Generate MIDI1.0 clock
+ * @brief Generate MIDI1.0 clock, with the fraction of a tick carried
+ * like midi1_clock_cntr_update_sbpm()
  *
  * @param sbpm scaled BPM like 123.12 must be entered like 12312
  */
@@ -82,6 +216,20 @@ void midi1_clock_cntr_gen_sbpm(uint16_t sbpm);
  */
 uint16_t midi1_clock_cntr_get_sbpm();
 
+/**
+ * @brief Blocks until the counter ISR queued clock ticks and sends them
+ * to the USB and DIN outputs that are due, with the transport messages
+ * that go with them.
+ *
+ * @note Call this in a loop from a high priority thread.
+ */
+void midi1_clock_cntr_sender(void);
+
+/**
+ * @brief Copy of the clock sender counters.
+ */
+void midi1_clock_cntr_get_stats(struct midi1_clock_cntr_stats *stats);
+
 
 #endif /* MIDI1_CLOCK_TIMER */
 /* EOF */
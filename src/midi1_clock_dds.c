@@ -0,0 +1,62 @@
+/**
+ * @file midi1_clock_dds.c
+ * @brief Fractional tick period accumulator, see midi1_clock_dds.h
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+
+#include "midi1_tempo.h"
+#include "midi1_clock_dds.h"
+
+#define SECONDS_PER_MINUTE 60u
+
+void midi1_clock_dds_init(struct midi1_clock_dds *dds, uint16_t sbpm,
+			  uint32_t clock_hz, uint8_t ppqn)
+{
+	/* Both fit easily: 48 MHz * 6000 and 65535 * 255 */
+	const uint64_t numer = (uint64_t)clock_hz * SECONDS_PER_MINUTE *
+			       BPM_SCALE;
+	const uint32_t denom = (uint32_t)sbpm * ppqn;
+	uint64_t ticks;
+
+	if (denom == 0) {
+		midi1_clock_dds_init_ticks(dds, 0);
+		return;
+	}
+	ticks = numer / denom;
+	if (ticks > UINT32_MAX) {
+		/* Slower than the counter can count, not a tempo */
+		midi1_clock_dds_init_ticks(dds, UINT32_MAX);
+		return;
+	}
+	dds->ticks = (uint32_t)ticks;
+	dds->frac = (uint32_t)(numer % denom);
+	dds->denom = denom;
+	dds->acc = 0;
+}
+
+void midi1_clock_dds_init_ticks(struct midi1_clock_dds *dds, uint32_t ticks)
+{
+	dds->ticks = ticks;
+	dds->frac = 0;
+	dds->denom = 1;
+	dds->acc = 0;
+}
+
+void midi1_clock_dds_init_div(struct midi1_clock_dds *dds, uint32_t ticks,
+			      uint8_t div)
+{
+	if (div <= 1) {
+		midi1_clock_dds_init_ticks(dds, ticks);
+		return;
+	}
+	dds->ticks = ticks / div;
+	dds->frac = ticks % div;
+	dds->denom = div;
+	dds->acc = 0;
+}
+
+/* EOF */
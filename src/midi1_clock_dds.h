@@ -0,0 +1,71 @@
+/**
+ * @file midi1_clock_dds.h
+ * @brief Fractional tick period accumulator for the clock generator.
+ *
+ * @note
+ * A clock period is clock_hz * 60 * BPM_SCALE / (sbpm * ppqn) counter
+ * ticks, which is rarely a whole number.  sbpm_to_ticks() rounds it and
+ * repeating the rounded period drifts: at 48 MHz and 123.45 BPM it is
+ * 0.46 tick per clock, about 1.7 ms per hour.  Here the remainder is
+ * carried Bresenham style, so the periods alternate between N and N+1
+ * ticks and the sum of any number of periods is never more than one
+ * tick away from the exact value.  The long run average is exact.
+ *
+ * Integer only, no hardware, like midi1.c.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_CLOCK_DDS_H
+#define MIDI1_CLOCK_DDS_H
+
+#include <stdint.h>
+
+/* MIDI clock */
+#define MIDI1_CLOCK_DDS_PPQN 24
+
+struct midi1_clock_dds {
+	uint32_t ticks;		/* whole ticks per period, N */
+	uint32_t frac;		/* remainder per period */
+	uint32_t denom;		/* frac / denom is the fraction of a tick */
+	uint32_t acc;		/* carried remainder, always < denom */
+};
+
+/**
+ * @brief Set up for a tempo, the accumulator starts at 0.
+ *
+ * @param sbpm scaled BPM like 123.12 must be entered like 12312
+ * @param clock_hz counter frequency
+ * @param ppqn pulses per quarter note, MIDI1_CLOCK_DDS_PPQN for MIDI clock
+ */
+void midi1_clock_dds_init(struct midi1_clock_dds *dds, uint16_t sbpm,
+			  uint32_t clock_hz, uint8_t ppqn);
+
+/**
+ * @brief A whole number of ticks per period, no fraction.
+ */
+void midi1_clock_dds_init_ticks(struct midi1_clock_dds *dds, uint32_t ticks);
+
+/**
+ * @brief A period of ticks split in div shorter periods, e.g. a 24 PPQN
+ * period for a 96 PPQN clock.  Every div periods add up to ticks.
+ */
+void midi1_clock_dds_init_div(struct midi1_clock_dds *dds, uint32_t ticks,
+			      uint8_t div);
+
+/**
+ * @brief Length of the next period, N or N+1 ticks.
+ */
+static inline uint32_t midi1_clock_dds_next(struct midi1_clock_dds *dds)
+{
+	dds->acc += dds->frac;
+	if (dds->acc >= dds->denom) {
+		dds->acc -= dds->denom;
+		return dds->ticks + 1;
+	}
+	return dds->ticks;
+}
+
+#endif /* MIDI1_CLOCK_DDS_H */
+/* EOF */
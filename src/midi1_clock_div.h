@@ -0,0 +1,51 @@
+/**
+ * @file midi1_clock_div.h
+ * @brief Tick divider of a clock fan-out output.
+ *
+ * @note
+ * An output fires on master tick n when n is a multiple of its divider.
+ * It keeps a count of the master ticks to its next output tick, the
+ * clock ISR only decrements it.  midi1_clock_div_count() puts the count
+ * in phase with any tick number, the modulo is done there and not in
+ * the ISR.  Integer only, no hardware, like midi1_clock_dds.h, so the
+ * host checks run it too.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_CLOCK_DIV_H
+#define MIDI1_CLOCK_DIV_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/**
+ * @brief Count for an output whose next master tick has number tick:
+ * master ticks to the next multiple of the divider, + 1.
+ *
+ * @param divider master ticks per output tick, >= 1
+ */
+static inline uint8_t midi1_clock_div_count(uint8_t divider, uint32_t tick)
+{
+	uint32_t rest = tick % divider;
+
+	return (rest == 0) ? 1 : divider - rest + 1;
+}
+
+/**
+ * @brief One master tick.
+ *
+ * @return true when the output fires on it
+ */
+static inline bool midi1_clock_div_tick(uint8_t *count, uint8_t divider)
+{
+	if (--*count != 0) {
+		return false;
+	}
+	*count = divider;
+	return true;
+}
+
+#endif /* MIDI1_CLOCK_DIV_H */
+/* EOF */
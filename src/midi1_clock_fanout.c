@@ -0,0 +1,302 @@
+/**
+ * @file midi1_clock_fanout.c
+ * @brief Clock fan-out with per output dividers, see midi1_clock_fanout.h
+ *
+ * @note
+ * The ISR side is a decrement and compare per output, no divides, the
+ * Cortex-M0+ has no divide instruction.  The modulo that puts an output
+ * in phase is done when it is configured, in the thread that does that,
+ * see midi1_clock_div.h.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio.h>
+#include <zephyr/audio/midi.h>
+#include <zephyr/usb/class/usbd_midi2.h>
+
+#include "midi1.h"
+#include "midi1_serial.h"
+#include "midi1_clock_fanout.h"
+#include "midi1_clock_div.h"
+
+static struct midi1_clock_out *g_outputs[MIDI1_CLOCK_FANOUT_MAX];
+static uint8_t g_num_outputs;
+/* Master ticks since the reset, the number of the next tick */
+static uint32_t g_tick;
+/* Prepared restart: the tick number and master ticks to go, 0 is none */
+static uint32_t g_restart_tick;
+static uint8_t g_restart_lead;
+static struct k_spinlock g_lock;
+
+/*
+ * Put the output in phase with the tick count.  Called with g_lock
+ * held.
+ */
+static void midi1_clock_fanout_align(struct midi1_clock_out *out)
+{
+	out->count = midi1_clock_div_count(out->divider, g_tick);
+	out->restart = midi1_clock_div_count(out->divider, g_restart_tick);
+}
+
+int midi1_clock_fanout_add(struct midi1_clock_out *out)
+{
+	k_spinlock_key_t key;
+	int ret;
+
+	if (out->divider == 0 ||
+	    (out->type == MIDI1_CLOCK_OUT_GPIO && out->gpio == NULL)) {
+		return -EINVAL;
+	}
+	for (uint8_t i = 0; i < g_num_outputs; i++) {
+		if (g_outputs[i] == out) {
+			return i;
+		}
+	}
+	if (g_num_outputs >= MIDI1_CLOCK_FANOUT_MAX) {
+		return -ENOMEM;
+	}
+	if (out->type == MIDI1_CLOCK_OUT_GPIO) {
+		ret = gpio_pin_configure_dt(out->gpio, GPIO_OUTPUT_INACTIVE);
+		if (ret < 0) {
+			printk("Error configing clock output pin\n");
+			return ret;
+		}
+	}
+
+	key = k_spin_lock(&g_lock);
+	out->high = 0;
+	midi1_clock_fanout_align(out);
+	ret = g_num_outputs;
+	g_outputs[g_num_outputs++] = out;
+	k_spin_unlock(&g_lock, key);
+	return ret;
+}
+
+void midi1_clock_fanout_enable(struct midi1_clock_out *out, bool enable)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+
+	midi1_clock_fanout_align(out);
+	out->enabled = enable;
+	k_spin_unlock(&g_lock, key);
+}
+
+void midi1_clock_fanout_set_divider(struct midi1_clock_out *out,
+				    uint8_t divider)
+{
+	k_spinlock_key_t key;
+
+	if (divider == 0) {
+		return;
+	}
+	key = k_spin_lock(&g_lock);
+	out->divider = divider;
+	midi1_clock_fanout_align(out);
+	k_spin_unlock(&g_lock, key);
+}
+
+void midi1_clock_fanout_reset(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+
+	g_tick = 0;
+	g_restart_lead = 0;
+	for (uint8_t i = 0; i < g_num_outputs; i++) {
+		struct midi1_clock_out *out = g_outputs[i];
+
+		out->count = 1;
+		out->high = 0;
+		if (out->type == MIDI1_CLOCK_OUT_GPIO) {
+			gpio_pin_set_dt(out->gpio, 0);
+		}
+	}
+	k_spin_unlock(&g_lock, key);
+}
+
+void midi1_clock_fanout_prepare(uint32_t tick)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+
+	g_restart_tick = tick;
+	for (uint8_t i = 0; i < g_num_outputs; i++) {
+		g_outputs[i]->restart = midi1_clock_div_count(g_outputs[i]->divider,
+							      tick);
+	}
+	k_spin_unlock(&g_lock, key);
+}
+
+void midi1_clock_fanout_restart(uint8_t lead)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+
+	g_restart_lead = lead;
+	k_spin_unlock(&g_lock, key);
+}
+
+/* Divided tick of a GPIO output */
+static void midi1_clock_fanout_pin(struct midi1_clock_out *out)
+{
+	if (out->pulse == 0) {
+		gpio_pin_toggle_dt(out->gpio);
+		return;
+	}
+	gpio_pin_set_dt(out->gpio, 1);
+	out->high = out->pulse;
+}
+
+uint32_t midi1_clock_fanout_tick(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+	uint32_t due = 0;
+
+	if (g_restart_lead != 0 && --g_restart_lead == 0) {
+		/* This is the prepared tick, counts precomputed */
+		g_tick = g_restart_tick;
+		for (uint8_t i = 0; i < g_num_outputs; i++) {
+			g_outputs[i]->count = g_outputs[i]->restart;
+		}
+	}
+	g_tick++;
+	for (uint8_t i = 0; i < g_num_outputs; i++) {
+		struct midi1_clock_out *out = g_outputs[i];
+
+		/* End of a pulse first, the next one may start right away */
+		if (out->high != 0 && --out->high == 0) {
+			gpio_pin_set_dt(out->gpio, 0);
+		}
+		if (!midi1_clock_div_tick(&out->count, out->divider) ||
+		    !out->enabled) {
+			continue;
+		}
+		if (out->type == MIDI1_CLOCK_OUT_GPIO) {
+			midi1_clock_fanout_pin(out);
+		} else {
+			due |= BIT(i);
+		}
+	}
+	k_spin_unlock(&g_lock, key);
+	return due;
+}
+
+uint32_t midi1_clock_fanout_ticks(void)
+{
+	return g_tick;
+}
+
+uint32_t midi1_clock_fanout_send(uint32_t due, const struct device *usb_midi)
+{
+	uint32_t errors = 0;
+
+	for (uint8_t i = 0; due != 0; i++, due >>= 1) {
+		const struct midi1_clock_out *out = g_outputs[i];
+
+		if (!(due & 1U)) {
+			continue;
+		}
+		switch (out->type) {
+		case MIDI1_CLOCK_OUT_USB:
+			if (usb_midi == NULL) {
+				break;
+			}
+			if (usbd_midi_send(usb_midi,
+					   UMP_SYS_RT_COMMON(out->index,
+							     RT_TIMING_CLOCK,
+							     0, 0)) != 0) {
+				errors++;
+			}
+			break;
+		case MIDI1_CLOCK_OUT_DIN:
+			SerialMidiTimingClock(out->index);
+			break;
+		default:
+			break;
+		}
+	}
+	return errors;
+}
+
+uint32_t midi1_clock_fanout_send_message(uint8_t status, uint8_t d1,
+					 uint8_t d2,
+					 const struct device *usb_midi)
+{
+	uint32_t errors = 0;
+
+	for (uint8_t i = 0; i < g_num_outputs; i++) {
+		const struct midi1_clock_out *out = g_outputs[i];
+
+		if (!out->enabled) {
+			continue;
+		}
+		switch (out->type) {
+		case MIDI1_CLOCK_OUT_USB:
+			if (usb_midi == NULL) {
+				break;
+			}
+			if (usbd_midi_send(usb_midi,
+					   UMP_SYS_RT_COMMON(out->index, status,
+							     d1, d2)) != 0) {
+				errors++;
+			}
+			break;
+		case MIDI1_CLOCK_OUT_DIN:
+			if (SerialMidiSendMessage(out->index, status,
+						  d1, d2) != 0) {
+				errors++;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return errors;
+}
+
+uint32_t midi1_clock_fanout_send_continue(uint16_t sixteenths,
+					  const struct device *usb_midi)
+{
+	const uint8_t lsb = sixteenths & MIDI_DATA;
+	const uint8_t msb = (sixteenths >> 7) & MIDI_DATA;
+	uint32_t errors = 0;
+
+	for (uint8_t i = 0; i < g_num_outputs; i++) {
+		const struct midi1_clock_out *out = g_outputs[i];
+
+		if (!out->enabled) {
+			continue;
+		}
+		switch (out->type) {
+		case MIDI1_CLOCK_OUT_USB:
+			if (usb_midi == NULL) {
+				break;
+			}
+			if (usbd_midi_send(usb_midi,
+					   UMP_SYS_RT_COMMON(out->index,
+							     SYSTEM_SONG_POSITION,
+							     lsb, msb)) != 0) {
+				errors++;
+			}
+			if (usbd_midi_send(usb_midi,
+					   UMP_SYS_RT_COMMON(out->index,
+							     RT_CONTINUE,
+							     0, 0)) != 0) {
+				errors++;
+			}
+			break;
+		case MIDI1_CLOCK_OUT_DIN:
+			/* Not through the realtime lane, see midi1_serial.h */
+			if (SerialMidiSongPositionContinue(out->index,
+							   sixteenths) != 0) {
+				errors++;
+			}
+			break;
+		default:
+			break;
+		}
+	}
+	return errors;
+}
+
+/* EOF */
@@ -0,0 +1,175 @@
+/**
+ * @file midi1_clock_fanout.h
+ * @brief One master clock, many outputs each with its own divider.
+ *
+ * @note
+ * The counter generator (midi1_clock_counter.h) runs at
+ * MIDI1_CLOCK_FANOUT_PPQN and calls midi1_clock_fanout_tick() from its
+ * ISR for every master tick.  Every output counts those ticks down with
+ * its own divider, so a 24 PPQN MIDI clock, a DIN Sync pin and
+ * a 1/16 note trigger all come from the same tick number and can not
+ * drift apart.  Dividers are aligned to the tick count, an output that
+ * is enabled or changed later fires on the same ticks as if it had been
+ * running from the start.
+ *
+ * GPIO outputs are driven in the ISR itself, USB and DIN outputs only
+ * return a due bit and are sent by midi1_clock_fanout_send() from the
+ * clock sender thread.
+ *
+ * The transport (midi1_transport.h) moves the tick count to the song
+ * position on Start and Continue: midi1_clock_fanout_prepare() does the
+ * alignment in its thread and midi1_clock_fanout_restart() applies it
+ * from the ISR.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_CLOCK_FANOUT_H
+#define MIDI1_CLOCK_FANOUT_H
+
+#include <zephyr/kernel.h>
+#include <zephyr/drivers/gpio.h>
+#include <stdint.h>
+#include <stdbool.h>
+
+/* Master ticks per quarter note */
+#define MIDI1_CLOCK_FANOUT_PPQN 96
+
+/**
+ * @note Maximum number of outputs, a due mask has one bit per output
+ */
+#ifndef MIDI1_CLOCK_FANOUT_MAX
+#define MIDI1_CLOCK_FANOUT_MAX 8
+#endif
+
+/* Dividers of the master for the usual rates */
+#define MIDI1_CLOCK_DIV_96PPQN	1
+#define MIDI1_CLOCK_DIV_48PPQN	2
+#define MIDI1_CLOCK_DIV_24PPQN	4	/* MIDI clock */
+#define MIDI1_CLOCK_DIV_DIN_SYNC 4	/* Roland DIN Sync, 24 PPQN */
+#define MIDI1_CLOCK_DIV_16TH	24	/* 1/16 note trigger */
+#define MIDI1_CLOCK_DIV_QUARTER	96
+
+enum midi1_clock_out_type {
+	MIDI1_CLOCK_OUT_USB,	/* timing clock on a UMP group */
+	MIDI1_CLOCK_OUT_DIN,	/* timing clock on a DIN port */
+	MIDI1_CLOCK_OUT_GPIO,	/* pulse or square wave on a pin */
+};
+
+/**
+ * @brief One output.  The struct is owned by the caller and must stay
+ * valid after midi1_clock_fanout_add(), like a serial MIDI listener.
+ *
+ * A GPIO output with pulse 0 toggles on every divided tick, a square
+ * wave at half the divided rate.  With pulse n the pin goes high on the
+ * divided tick and low again n master ticks later, n < divider.  DIN
+ * Sync is MIDI1_CLOCK_DIV_DIN_SYNC with pulse 2: 24 PPQN at 50 % duty.
+ */
+struct midi1_clock_out {
+	uint8_t type;		/* enum midi1_clock_out_type */
+	uint8_t index;		/* UMP group or DIN port */
+	const struct gpio_dt_spec *gpio;
+	uint8_t divider;	/* master ticks per output tick, >= 1 */
+	uint8_t pulse;		/* GPIO high time in master ticks */
+	bool enabled;
+	/* Below are private to midi1_clock_fanout.c */
+	uint8_t count;		/* master ticks to the next output tick */
+	uint8_t high;		/* master ticks the pin stays high */
+	uint8_t restart;	/* count at the prepared tick */
+};
+
+/**
+ * @brief Add an output.  GPIO pins are configured as inactive outputs.
+ * Adding one that is already there does nothing.
+ *
+ * @return output number, the bit in the due mask, or -ENOMEM, -EINVAL
+ */
+int midi1_clock_fanout_add(struct midi1_clock_out *out);
+
+/**
+ * @brief Enable or disable an output, it comes back in phase.
+ */
+void midi1_clock_fanout_enable(struct midi1_clock_out *out, bool enable);
+
+/**
+ * @brief Change the divider of an output, it stays in phase with the
+ * tick count.  0 is ignored.
+ */
+void midi1_clock_fanout_set_divider(struct midi1_clock_out *out,
+				    uint8_t divider);
+
+/**
+ * @brief Back to master tick 0, every output fires on the next tick.
+ * GPIO outputs go inactive.  Called when the generator starts.
+ */
+void midi1_clock_fanout_reset(void);
+
+/**
+ * @brief Work out the counts for a later midi1_clock_fanout_restart(),
+ * from a thread.
+ *
+ * @param tick number the restart tick gets, e.g. the song position
+ */
+void midi1_clock_fanout_prepare(uint32_t tick);
+
+/**
+ * @brief The lead-th master tick from now gets the prepared number,
+ * every output fires on it as if it had counted from 0.  The ticks in
+ * between run as before.  From the counter ISR.
+ *
+ * @param lead master ticks, > 0
+ */
+void midi1_clock_fanout_restart(uint8_t lead);
+
+/**
+ * @brief One master tick, from the counter ISR.
+ *
+ * @return due mask of the USB and DIN outputs, bit n is output n
+ */
+uint32_t midi1_clock_fanout_tick(void);
+
+/**
+ * @brief Master ticks since midi1_clock_fanout_reset()
+ */
+uint32_t midi1_clock_fanout_ticks(void);
+
+/**
+ * @brief Send the timing clock on the outputs in a due mask, from a
+ * thread.
+ *
+ * @param due mask from midi1_clock_fanout_tick()
+ * @param usb_midi USB MIDI device, NULL skips the USB outputs
+ * @return number of usbd_midi_send() errors
+ */
+uint32_t midi1_clock_fanout_send(uint32_t due, const struct device *usb_midi);
+
+/**
+ * @brief Send a system common or realtime message on every enabled USB
+ * and DIN output, whatever its divider.  For the transport messages.
+ *
+ * @param status e.g. RT_START or SYSTEM_SONG_POSITION
+ * @param d1 first data byte, 0 when unused
+ * @param d2 second data byte, 0 when unused
+ * @param usb_midi USB MIDI device, NULL skips the USB outputs
+ * @return number of send errors
+ */
+uint32_t midi1_clock_fanout_send_message(uint8_t status, uint8_t d1,
+					 uint8_t d2,
+					 const struct device *usb_midi);
+
+/**
+ * @brief Send song position and Continue on every enabled USB and DIN
+ * output, the position first.  On DIN both go through the TX ring, a
+ * Continue in the realtime lane would overtake the position, and the
+ * next clocks wait for the Continue.
+ *
+ * @param sixteenths song position
+ * @param usb_midi USB MIDI device, NULL skips the USB outputs
+ * @return number of send errors
+ */
+uint32_t midi1_clock_fanout_send_continue(uint16_t sixteenths,
+					  const struct device *usb_midi);
+
+#endif /* MIDI1_CLOCK_FANOUT_H */
+/* EOF */
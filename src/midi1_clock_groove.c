@@ -0,0 +1,79 @@
+/**
+ * @file midi1_clock_groove.c
+ * @brief Swing/shuffle groove tables, see midi1_clock_groove.h
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <errno.h>
+
+#include "midi1_clock_groove.h"
+
+const struct midi1_clock_groove_table midi1_clock_groove_straight;
+
+void midi1_clock_groove_table_offsets(struct midi1_clock_groove_table *table,
+				      const int32_t *offset, uint8_t subdiv)
+{
+	int32_t delta;
+	int32_t next;
+
+	for (uint8_t pulse = 0; pulse < MIDI1_CLOCK_GROOVE_PULSES; pulse++) {
+		/* The last pulse leads to the first one of the next beat */
+		next = (pulse + 1 < MIDI1_CLOCK_GROOVE_PULSES) ?
+		       offset[pulse + 1] : offset[0];
+		delta = next - offset[pulse];
+		/* Both round towards 0, rest is less than subdiv either way */
+		table->adjust[pulse] = delta / subdiv;
+		table->rest[pulse] = (int8_t)(delta - table->adjust[pulse] * subdiv);
+	}
+}
+
+/*
+ * A pair of notes is 2 * note pulses.  At swing s the first note is
+ * stretched to 2 * s of the pair and the second squeezed in the rest,
+ * pulse q of the pair then is (2 * s - 1) * q pulses late in the first
+ * note and (2 * s - 1) * (2 * note - q) in the second.
+ */
+int midi1_clock_groove_table_swing(struct midi1_clock_groove_table *table,
+				   uint8_t percent, uint8_t note,
+				   uint32_t pulse_ticks, uint8_t subdiv)
+{
+	int32_t offset[MIDI1_CLOCK_GROOVE_PULSES];
+	const uint8_t pair = 2 * note;
+	/* (2 * s - 1) in percent */
+	const int64_t depth = 2 * (int64_t)percent - 100;
+	uint8_t q;
+
+	if (percent < MIDI1_CLOCK_GROOVE_STRAIGHT ||
+	    percent > MIDI1_CLOCK_GROOVE_SWING_MAX || note == 0 ||
+	    MIDI1_CLOCK_GROOVE_PULSES % pair != 0 || subdiv == 0) {
+		return -EINVAL;
+	}
+	q = 0;
+	for (uint8_t pulse = 0; pulse < MIDI1_CLOCK_GROOVE_PULSES; pulse++) {
+		offset[pulse] = (int32_t)(depth * (q <= note ? q : pair - q) *
+					  pulse_ticks / 100);
+		if (++q == pair) {
+			q = 0;
+		}
+	}
+	midi1_clock_groove_table_offsets(table, offset, subdiv);
+	return 0;
+}
+
+void midi1_clock_groove_init(struct midi1_clock_groove *groove,
+			     uint8_t subdiv)
+{
+	groove->table = NULL;
+	groove->pending = NULL;
+	groove->subdiv = subdiv;
+	groove->pulse = 0;
+	groove->sub = 0;
+	groove->seek_pulse = 0;
+	groove->seek_after = 0;
+}
+
+/* EOF */
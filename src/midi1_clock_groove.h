@@ -0,0 +1,181 @@
+/**
+ * @file midi1_clock_groove.h
+ * @brief Swing/shuffle: moves 24 PPQN pulses within the beat.
+ *
+ * @note
+ * A groove table says how far every 24 PPQN pulse of a beat is moved
+ * from its straight position, in counter ticks.  The generator adds the
+ * difference of two neighbouring offsets to the period in between, so
+ * the groove is in the reload value and not in the send.  The offsets
+ * are back to 0 at the end of the beat, over a beat the adjustments add
+ * up to 0 and the groove never drifts away from the tempo.
+ *
+ * Swing moves the second note of every pair: at 50 % it is straight, at
+ * 66 % a triplet shuffle, at 75 % a dotted note and its short partner.
+ * The pulses in between are moved along so every divided output sees
+ * the same swing.
+ *
+ * A table is computed once per swing amount and tempo, in a thread.
+ * Per period midi1_clock_groove_next() is an index and an add.  A new
+ * table only takes over at the start of a beat.  Integer only, no
+ * hardware, like midi1_clock_dds.h.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_CLOCK_GROOVE_H
+#define MIDI1_CLOCK_GROOVE_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/* 24 PPQN pulses per beat */
+#define MIDI1_CLOCK_GROOVE_PULSES 24
+
+/* Swing in percent */
+#define MIDI1_CLOCK_GROOVE_STRAIGHT 50
+#define MIDI1_CLOCK_GROOVE_SWING_MAX 75
+
+/* Pulses of the swung note */
+#define MIDI1_CLOCK_GROOVE_8TH 12
+#define MIDI1_CLOCK_GROOVE_16TH 6
+
+/**
+ * @brief Per pulse period adjustment.  A pulse is subdiv periods of the
+ * generator, each gets adjust and the first one rest on top.
+ */
+struct midi1_clock_groove_table {
+	int32_t adjust[MIDI1_CLOCK_GROOVE_PULSES];
+	int8_t rest[MIDI1_CLOCK_GROOVE_PULSES];
+};
+
+struct midi1_clock_groove {
+	const struct midi1_clock_groove_table *table;	/* NULL is straight */
+	const struct midi1_clock_groove_table *pending;	/* from next beat */
+	uint8_t subdiv;		/* generator periods per pulse */
+	uint8_t pulse;		/* in the beat */
+	uint8_t sub;		/* period in the pulse */
+	uint8_t seek_pulse;	/* see midi1_clock_groove_seek() */
+	uint8_t seek_after;
+};
+
+/* All zero, pending to go back to straight */
+extern const struct midi1_clock_groove_table midi1_clock_groove_straight;
+
+/**
+ * @brief Table from offsets, offset[0] should be 0.
+ *
+ * @param offset ticks every pulse of the beat is moved, + is later
+ * @param subdiv generator periods per 24 PPQN pulse, > 0
+ */
+void midi1_clock_groove_table_offsets(struct midi1_clock_groove_table *table,
+				      const int32_t *offset, uint8_t subdiv);
+
+/**
+ * @brief Swing table.
+ *
+ * @param percent MIDI1_CLOCK_GROOVE_STRAIGHT .. MIDI1_CLOCK_GROOVE_SWING_MAX
+ * @param note pulses of the swung note, e.g. MIDI1_CLOCK_GROOVE_16TH,
+ *             two of them must fit a beat a whole number of times
+ * @param pulse_ticks straight 24 PPQN period in ticks
+ * @param subdiv generator periods per pulse, > 0
+ * @return 0 or -EINVAL
+ */
+int midi1_clock_groove_table_swing(struct midi1_clock_groove_table *table,
+				   uint8_t percent, uint8_t note,
+				   uint32_t pulse_ticks, uint8_t subdiv);
+
+/**
+ * @brief Straight, at the first period of a beat.
+ */
+void midi1_clock_groove_init(struct midi1_clock_groove *groove,
+			     uint8_t subdiv);
+
+/* The pending table takes over */
+static inline void midi1_clock_groove_latch(struct midi1_clock_groove *groove)
+{
+	if (groove->pending == &midi1_clock_groove_straight) {
+		groove->table = NULL;
+	} else {
+		groove->table = groove->pending;
+	}
+	groove->pending = NULL;
+}
+
+/**
+ * @brief Back to the first period of a beat, a pending table takes
+ * over straight away.
+ */
+static inline void midi1_clock_groove_reset(struct midi1_clock_groove *groove)
+{
+	groove->pulse = 0;
+	groove->sub = 0;
+	groove->seek_after = 0;
+	if (groove->pending != NULL) {
+		midi1_clock_groove_latch(groove);
+	}
+}
+
+/**
+ * @brief Move to the first period of a pulse, for the after-th call of
+ * midi1_clock_groove_next() from now.  For a song position.
+ */
+static inline void midi1_clock_groove_seek(struct midi1_clock_groove *groove,
+					   uint8_t pulse, uint8_t after)
+{
+	groove->seek_pulse = pulse;
+	groove->seek_after = after;
+}
+
+/**
+ * @brief Use a table from the next beat on, NULL for straight.  The
+ * table must not change until it is replaced.
+ */
+static inline void midi1_clock_groove_set(struct midi1_clock_groove *groove,
+					  const struct midi1_clock_groove_table *table)
+{
+	groove->pending = (table != NULL) ? table : &midi1_clock_groove_straight;
+}
+
+static inline bool midi1_clock_groove_active(const struct midi1_clock_groove *groove)
+{
+	return groove->table != NULL || groove->pending != NULL;
+}
+
+/**
+ * @brief Adjustment in ticks for the next generator period.
+ */
+static inline int32_t midi1_clock_groove_next(struct midi1_clock_groove *groove)
+{
+	const struct midi1_clock_groove_table *table;
+	uint8_t pulse;
+	int32_t adjust = 0;
+
+	if (groove->seek_after != 0 && --groove->seek_after == 0) {
+		groove->pulse = groove->seek_pulse;
+		groove->sub = 0;
+	}
+	pulse = groove->pulse;
+	if (pulse == 0 && groove->sub == 0 && groove->pending != NULL) {
+		midi1_clock_groove_latch(groove);
+	}
+	table = groove->table;
+	if (table != NULL) {
+		adjust = table->adjust[pulse];
+		if (groove->sub == 0) {
+			adjust += table->rest[pulse];
+		}
+	}
+	if (++groove->sub == groove->subdiv) {
+		groove->sub = 0;
+		if (++groove->pulse == MIDI1_CLOCK_GROOVE_PULSES) {
+			groove->pulse = 0;
+		}
+	}
+	return adjust;
+}
+
+#endif /* MIDI1_CLOCK_GROOVE_H */
+/* EOF */
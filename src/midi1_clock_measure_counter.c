@@ -45,6 +45,9 @@ static inline uint32_t midi1_clock_meas_now_ticks(void)
 {
 	uint32_t ticks = 0;
 
+	if (g_counter_dev_ch1 == NULL) {
+		return 0;
+	}
 	int err = counter_get_value(g_counter_dev_ch1, &ticks);
 	if (err != 0) {
 		printk("counter_get_value error\n");
@@ -99,10 +102,31 @@ void midi1_clock_meas_cntr_init(void)
 }
 
 /* ------------------------------------------------------------------ */
+uint32_t midi1_clock_meas_cntr_now(void)
+{
+	return midi1_clock_meas_now_ticks();
+}
+
+uint32_t midi1_clock_meas_cntr_since_us(uint32_t since_ticks)
+{
+	if (g_counter_dev_ch1 == NULL) {
+		return 0;
+	}
+	/* Down-counter, elapsed = earlier - now (unsigned wrap-safe) */
+	return counter_ticks_to_us(g_counter_dev_ch1,
+				   since_ticks - midi1_clock_meas_now_ticks());
+}
+
 void midi1_clock_meas_cntr_pulse(void)
 {
-	uint32_t now_ticks = midi1_clock_meas_now_ticks();
-	
+	midi1_clock_meas_cntr_pulse_ts(midi1_clock_meas_now_ticks());
+}
+
+/*
+ * The actual measurement, now_ticks is the moment the 0xF8 arrived.
+ */
+void midi1_clock_meas_cntr_pulse_ts(uint32_t now_ticks)
+{
 	/* Expose timestamp to PLL or other users */
 	g_last_tick_timestamp_ticks = now_ticks;
 	
@@ -51,6 +51,35 @@ void midi1_clock_meas_cntr_init(void);
  */
 void midi1_clock_meas_cntr_pulse(void);
 
+/**
+ * @brief Same as midi1_clock_meas_cntr_pulse() with the timestamp taken
+ * by the caller.
+ *
+ * @note Use this when the pulse was timestamped earlier, e.g. in the UART
+ * ISR that received the 0xF8, so thread scheduling delays don't end up in
+ * the measured interval.
+ * @param now_ticks counter value from midi1_clock_meas_cntr_now()
+ */
+void midi1_clock_meas_cntr_pulse_ts(uint32_t now_ticks);
+
+/**
+ * @brief Read the free-running measurement counter.
+ *
+ * @note Safe to call from an ISR.  Returns 0 when the counter was not
+ * initialized yet.
+ * @return counter value in ticks (decreasing if using PIT0 channel1)
+ */
+uint32_t midi1_clock_meas_cntr_now(void);
+
+/**
+ * @brief Microseconds elapsed since a counter value.
+ *
+ * @note Safe to call from an ISR.
+ * @param since_ticks earlier value of midi1_clock_meas_cntr_now()
+ * @return elapsed time in us
+ */
+uint32_t midi1_clock_meas_cntr_since_us(uint32_t since_ticks);
+
 /**
  * @brief Get last measured BPM in scaled form (BPM * 100).
  * @return 0 if no valid measurement yet.
@@ -0,0 +1,243 @@
+/**
+ * @file midi1_clock_ramp.c
+ * @brief Integer tempo ramps, see midi1_clock_ramp.h
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "midi1_tempo.h"
+#include "midi1_clock_ramp.h"
+
+#define SECONDS_PER_MINUTE 60u
+#define TEMPO_SHIFT 16
+#define LOG_SHIFT 24
+
+/*
+ * 2^(i/256) in 2.29 and log2(1 + i/256) in 8.24, i = 0..256.  Between
+ * two entries is interpolated, both are good to a few parts in a
+ * million: a tick or two on a period of 500000.
+ */
+static const uint32_t exp2_table[257] = {
+	0x20000000, 0x201635f5, 0x202c7b54, 0x2042d028, 0x2059347d, 0x206fa85c,
+	0x20862bd1, 0x209cbee6, 0x20b361a6, 0x20ca141c, 0x20e0d654, 0x20f7a857,
+	0x210e8a31, 0x21257bed, 0x213c7d96, 0x21538f36, 0x216ab0da, 0x2181e28c,
+	0x21992457, 0x21b07646, 0x21c7d866, 0x21df4ac0, 0x21f6cd60, 0x220e6052,
+	0x222603a0, 0x223db757, 0x22557b81, 0x226d502a, 0x2285355d, 0x229d2b27,
+	0x22b53191, 0x22cd48a9, 0x22e57079, 0x22fda90d, 0x2315f271, 0x232e4cb0,
+	0x2346b7d7, 0x235f33f0, 0x2377c108, 0x23905f2a, 0x23a90e63, 0x23c1cebd,
+	0x23daa046, 0x23f38308, 0x240c7711, 0x24257c6b, 0x243e9323, 0x2457bb45,
+	0x2470f4dd, 0x248a3ff7, 0x24a39c9f, 0x24bd0ae2, 0x24d68acc, 0x24f01c68,
+	0x2509bfc4, 0x252374eb, 0x253d3bea, 0x255714ce, 0x2570ffa2, 0x258afc73,
+	0x25a50b4e, 0x25bf2c3f, 0x25d95f52, 0x25f3a495, 0x260dfc14, 0x262865dc,
+	0x2642e1f9, 0x265d7077, 0x26781165, 0x2692c4ce, 0x26ad8abf, 0x26c86346,
+	0x26e34e6e, 0x26fe4c46, 0x27195cda, 0x27348037, 0x274fb66a, 0x276aff80,
+	0x27865b86, 0x27a1ca8a, 0x27bd4c98, 0x27d8e1be, 0x27f48a09, 0x28104587,
+	0x282c1444, 0x2847f64e, 0x2863ebb3, 0x287ff47f, 0x289c10c1, 0x28b84085,
+	0x28d483da, 0x28f0dacd, 0x290d456c, 0x2929c3c3, 0x294655e2, 0x2962fbd5,
+	0x297fb5aa, 0x299c8370, 0x29b96534, 0x29d65b04, 0x29f364ed, 0x2a1082ff,
+	0x2a2db546, 0x2a4afbd0, 0x2a6856ad, 0x2a85c5ea, 0x2aa34995, 0x2ac0e1bc,
+	0x2ade8e6d, 0x2afc4fb8, 0x2b1a25a9, 0x2b381050, 0x2b560fbb, 0x2b7423f7,
+	0x2b924d15, 0x2bb08b21, 0x2bcede2b, 0x2bed4642, 0x2c0bc373, 0x2c2a55ce,
+	0x2c48fd60, 0x2c67ba3a, 0x2c868c6a, 0x2ca573fd, 0x2cc47105, 0x2ce3838e,
+	0x2d02aba9, 0x2d21e963, 0x2d413ccd, 0x2d60a5f5, 0x2d8024ea, 0x2d9fb9bc,
+	0x2dbf6479, 0x2ddf2531, 0x2dfefbf3, 0x2e1ee8ce, 0x2e3eebd2, 0x2e5f050e,
+	0x2e7f3491, 0x2e9f7a6c, 0x2ebfd6ad, 0x2ee04963, 0x2f00d2a0, 0x2f217271,
+	0x2f4228e8, 0x2f62f613, 0x2f83da02, 0x2fa4d4c6, 0x2fc5e66e, 0x2fe70f09,
+	0x30084ea8, 0x3029a55c, 0x304b1333, 0x306c983d, 0x308e348c, 0x30afe82f,
+	0x30d1b337, 0x30f395b2, 0x31158fb3, 0x3137a149, 0x3159ca84, 0x317c0b76,
+	0x319e642d, 0x31c0d4bc, 0x31e35d32, 0x3205fda0, 0x3228b617, 0x324b86a7,
+	0x326e6f62, 0x32917057, 0x32b48998, 0x32d7bb35, 0x32fb0540, 0x331e67c9,
+	0x3341e2e2, 0x3365769b, 0x33892305, 0x33ace833, 0x33d0c634, 0x33f4bd1a,
+	0x3418ccf7, 0x343cf5db, 0x346137d9, 0x34859301, 0x34aa0764, 0x34ce9516,
+	0x34f33c26, 0x3517fca8, 0x353cd6ab, 0x3561ca42, 0x3586d780, 0x35abfe74,
+	0x35d13f33, 0x35f699cc, 0x361c0e53, 0x36419cd9, 0x36674571, 0x368d082b,
+	0x36b2e51c, 0x36d8dc54, 0x36feede6, 0x372519e4, 0x374b6061, 0x3771c16f,
+	0x37983d21, 0x37bed388, 0x37e584b8, 0x380c50c3, 0x383337bb, 0x385a39b4,
+	0x388156c0, 0x38a88ef2, 0x38cfe25d, 0x38f75113, 0x391edb28, 0x394680af,
+	0x396e41ba, 0x39961e5d, 0x39be16ab, 0x39e62ab7, 0x3a0e5a94, 0x3a36a656,
+	0x3a5f0e10, 0x3a8791d6, 0x3ab031ba, 0x3ad8edd1, 0x3b01c62e, 0x3b2abae4,
+	0x3b53cc08, 0x3b7cf9ac, 0x3ba643e6, 0x3bcfaac8, 0x3bf92e67, 0x3c22ced6,
+	0x3c4c8c2a, 0x3c766676, 0x3ca05dcf, 0x3cca7249, 0x3cf4a3f8, 0x3d1ef2f0,
+	0x3d495f45, 0x3d73e90d, 0x3d9e905b, 0x3dc95544, 0x3df437dd, 0x3e1f3839,
+	0x3e4a566f, 0x3e759292, 0x3ea0ecb7, 0x3ecc64f3, 0x3ef7fb5b, 0x3f23b004,
+	0x3f4f8303, 0x3f7b746d, 0x3fa78457, 0x3fd3b2d6, 0x40000000,
+};
+
+static const uint32_t log2_table[257] = {
+	0x00000000, 0x0001709c, 0x0002dfca, 0x00044d8c, 0x0005b9e6, 0x000724d9,
+	0x00088e69, 0x0009f698, 0x000b5d6a, 0x000cc2e0, 0x000e26fd, 0x000f89c5,
+	0x0010eb39, 0x00124b5b, 0x0013aa30, 0x001507b8, 0x001663f7, 0x0017beef,
+	0x001918a1, 0x001a7112, 0x001bc842, 0x001d1e35, 0x001e72ec, 0x001fc66a,
+	0x002118b1, 0x002269c3, 0x0023b9a3, 0x00250853, 0x002655d4, 0x0027a229,
+	0x0028ed54, 0x002a3757, 0x002b8034, 0x002cc7ee, 0x002e0e86, 0x002f53fe,
+	0x00309858, 0x0031db96, 0x00331dba, 0x00345ec6, 0x00359ebc, 0x0036dd9e,
+	0x00381b6e, 0x0039582c, 0x003a93dd, 0x003bce80, 0x003d0818, 0x003e40a6,
+	0x003f782d, 0x0040aeaf, 0x0041e42b, 0x004318a6, 0x00444c1f, 0x00457e9a,
+	0x0046b017, 0x0047e098, 0x0049101f, 0x004a3ead, 0x004b6c44, 0x004c98e6,
+	0x004dc493, 0x004eef4f, 0x00501919, 0x005141f4, 0x005269e1, 0x005390e2,
+	0x0054b6f8, 0x0055dc24, 0x00570069, 0x005823c7, 0x00594640, 0x005a67d5,
+	0x005b8887, 0x005ca859, 0x005dc74b, 0x005ee55f, 0x00600296, 0x00611ef1,
+	0x00623a72, 0x0063551a, 0x00646eea, 0x006587e4, 0x0066a009, 0x0067b75a,
+	0x0068cdd8, 0x0069e385, 0x006af862, 0x006c0c70, 0x006d1fb0, 0x006e3223,
+	0x006f43cc, 0x007054aa, 0x007164bf, 0x0072740c, 0x00738292, 0x00749053,
+	0x00759d50, 0x0076a989, 0x0077b4ff, 0x0078bfb5, 0x0079c9ab, 0x007ad2e1,
+	0x007bdb5a, 0x007ce316, 0x007dea16, 0x007ef05b, 0x007ff5e6, 0x0080fab9,
+	0x0081fed4, 0x00830239, 0x008404e8, 0x008506e2, 0x00860828, 0x008708bc,
+	0x0088089e, 0x008907cf, 0x008a0650, 0x008b0422, 0x008c0146, 0x008cfdbe,
+	0x008df989, 0x008ef4a9, 0x008fef1f, 0x0090e8eb, 0x0091e20f, 0x0092da8b,
+	0x0093d260, 0x0094c990, 0x0095c01a, 0x0096b601, 0x0097ab44, 0x00989fe4,
+	0x009993e3, 0x009a8742, 0x009b7a00, 0x009c6c1f, 0x009d5da0, 0x009e4e83,
+	0x009f3eca, 0x00a02e74, 0x00a11d84, 0x00a20bf9, 0x00a2f9d5, 0x00a3e718,
+	0x00a4d3c2, 0x00a5bfd6, 0x00a6ab53, 0x00a7963a, 0x00a8808c, 0x00a96a4a,
+	0x00aa5374, 0x00ab3c0c, 0x00ac2411, 0x00ad0b85, 0x00adf268, 0x00aed8bc,
+	0x00afbe80, 0x00b0a3b5, 0x00b1885c, 0x00b26c77, 0x00b35004, 0x00b43306,
+	0x00b5157d, 0x00b5f769, 0x00b6d8cb, 0x00b7b9a4, 0x00b899f5, 0x00b979bd,
+	0x00ba58ff, 0x00bb37b9, 0x00bc15ee, 0x00bcf39d, 0x00bdd0c8, 0x00bead6e,
+	0x00bf8991, 0x00c06531, 0x00c1404f, 0x00c21aeb, 0x00c2f506, 0x00c3cea0,
+	0x00c4a7ba, 0x00c58055, 0x00c65872, 0x00c73010, 0x00c80731, 0x00c8ddd4,
+	0x00c9b3fb, 0x00ca89a7, 0x00cb5ed7, 0x00cc338c, 0x00cd07c7, 0x00cddb88,
+	0x00ceaed0, 0x00cf819f, 0x00d053f7, 0x00d125d7, 0x00d1f740, 0x00d2c832,
+	0x00d398af, 0x00d468b6, 0x00d53848, 0x00d60765, 0x00d6d60f, 0x00d7a446,
+	0x00d87209, 0x00d93f5a, 0x00da0c3a, 0x00dad8a8, 0x00dba4a4, 0x00dc7031,
+	0x00dd3b4e, 0x00de05fb, 0x00ded039, 0x00df9a09, 0x00e0636a, 0x00e12c5e,
+	0x00e1f4e5, 0x00e2bcff, 0x00e384ad, 0x00e44bf0, 0x00e512c7, 0x00e5d933,
+	0x00e69f35, 0x00e764cd, 0x00e829fb, 0x00e8eec1, 0x00e9b31e, 0x00ea7712,
+	0x00eb3a9f, 0x00ebfdc5, 0x00ecc083, 0x00ed82db, 0x00ee44cd, 0x00ef065a,
+	0x00efc781, 0x00f08843, 0x00f148a1, 0x00f2089b, 0x00f2c832, 0x00f38765,
+	0x00f44636, 0x00f504a4, 0x00f5c2b0, 0x00f6805a, 0x00f73da4, 0x00f7fa8c,
+	0x00f8b714, 0x00f9733c, 0x00fa2f04, 0x00faea6d, 0x00fba578, 0x00fc6023,
+	0x00fd1a71, 0x00fdd460, 0x00fe8df2, 0x00ff4728, 0x01000000,
+};
+
+/* log2(x) in 8.24, x > 0 */
+static uint32_t midi1_clock_ramp_log2(uint32_t x)
+{
+	uint32_t n = 31 - __builtin_clz(x);
+	uint32_t m = x << (31 - n);	/* 1.31 */
+	uint32_t i = (m >> 23) & 0xFF;
+	uint32_t r = (m >> 9) & 0x3FFF;
+
+	return (n << LOG_SHIFT) + log2_table[i] +
+	       (((log2_table[i + 1] - log2_table[i]) * r) >> 14);
+}
+
+/* 2^l for l in 8.24, rounded to ticks */
+static uint32_t midi1_clock_ramp_exp2(uint32_t l)
+{
+	uint32_t e = l >> LOG_SHIFT;
+	uint32_t i = (l >> 16) & 0xFF;
+	uint32_t r = (l >> 6) & 0x3FF;
+	uint32_t v = exp2_table[i] +
+		     (((exp2_table[i + 1] - exp2_table[i]) * r) >> 10);
+
+	if (e >= 29) {
+		if (e > 31 || v > (UINT32_MAX >> (e - 29))) {
+			return UINT32_MAX;
+		}
+		return v << (e - 29);
+	}
+	return (v + (1UL << (28 - e))) >> (29 - e);
+}
+
+/* log2 of a 64 bit value in 8.24, the bits below the top 32 are lost */
+static uint32_t midi1_clock_ramp_log2_64(uint64_t x)
+{
+	uint32_t shift = 0;
+
+	while (x > UINT32_MAX) {
+		x >>= 1;
+		shift++;
+	}
+	return midi1_clock_ramp_log2((uint32_t)x) + (shift << LOG_SHIFT);
+}
+
+/* Ticks per period at 1.0 sbpm, in 16.16 so the divide gives ticks */
+static uint64_t midi1_clock_ramp_numer(uint32_t clock_hz, uint8_t ppqn)
+{
+	return ((uint64_t)clock_hz * SECONDS_PER_MINUTE * BPM_SCALE / ppqn)
+	       << TEMPO_SHIFT;
+}
+
+uint32_t midi1_clock_ramp_tempo(uint32_t ticks, uint32_t clock_hz,
+				uint8_t ppqn)
+{
+	if (ticks == 0 || ppqn == 0) {
+		return 0;
+	}
+	return (uint32_t)(midi1_clock_ramp_numer(clock_hz, ppqn) / ticks);
+}
+
+/* Period of the value a ramp is at */
+static uint32_t midi1_clock_ramp_period(const struct midi1_clock_ramp *ramp)
+{
+	if (ramp->curve == MIDI1_CLOCK_RAMP_EXPONENTIAL) {
+		return midi1_clock_ramp_exp2(ramp->value);
+	}
+	/* ticks = numer / tempo */
+	return midi1_clock_ramp_exp2(ramp->log_numer -
+				     midi1_clock_ramp_log2(ramp->value));
+}
+
+void midi1_clock_ramp_start(struct midi1_clock_ramp *ramp, uint32_t from,
+			    uint16_t to_sbpm, uint32_t clocks, uint8_t curve,
+			    uint32_t clock_hz, uint8_t ppqn)
+{
+	uint64_t numer;
+	int64_t total;
+
+	ramp->clocks = 0;
+	if (from == 0 || to_sbpm == 0 || ppqn == 0) {
+		return;
+	}
+	/* The divides are all here, not in the ISR */
+	numer = midi1_clock_ramp_numer(clock_hz, ppqn);
+	ramp->curve = curve;
+	ramp->period = from;
+	ramp->log_numer = midi1_clock_ramp_log2_64(numer);
+	if (curve == MIDI1_CLOCK_RAMP_EXPONENTIAL) {
+		ramp->value = midi1_clock_ramp_log2(from);
+		ramp->target = midi1_clock_ramp_log2((uint32_t)
+			(numer / ((uint32_t)to_sbpm << TEMPO_SHIFT)));
+	} else {
+		ramp->value = (uint32_t)(numer / from);
+		ramp->target = (uint32_t)to_sbpm << TEMPO_SHIFT;
+	}
+	if (clocks == 0) {
+		/* Step change on the next clock */
+		clocks = 1;
+	}
+	total = (int64_t)ramp->target - ramp->value;
+	ramp->delta = (int32_t)(total / (int64_t)clocks);
+	ramp->step = (total < 0) ? -1 : 1;
+	ramp->rem = (uint32_t)((total < 0 ? -total : total) % clocks);
+	ramp->acc = 0;
+	ramp->span = clocks;
+	ramp->clocks = clocks;
+}
+
+uint32_t midi1_clock_ramp_next(struct midi1_clock_ramp *ramp)
+{
+	if (ramp->clocks == 0) {
+		return 0;
+	}
+	if (--ramp->clocks == 0) {
+		/* No rounding left over at the end */
+		ramp->value = ramp->target;
+	} else {
+		ramp->value += ramp->delta;
+		/* The truncated part of the delta, Bresenham style */
+		ramp->acc += ramp->rem;
+		if (ramp->acc >= ramp->span) {
+			ramp->acc -= ramp->span;
+			ramp->value += ramp->step;
+		}
+	}
+	ramp->period = midi1_clock_ramp_period(ramp);
+	return ramp->period;
+}
+
+/* EOF */
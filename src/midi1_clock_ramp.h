@@ -0,0 +1,101 @@
+/**
+ * @file midi1_clock_ramp.h
+ * @brief Accelerando/ritardando: the clock period recomputed every clock.
+ *
+ * @note
+ * A ramp goes from the current tempo to a target tempo in a number of
+ * clocks, every clock gets the period of its own tempo:
+ *
+ *  - MIDI1_CLOCK_RAMP_LINEAR adds the same amount of BPM every clock,
+ *    the tempo is kept as sbpm in 16.16 so slow ramps still move.
+ *  - MIDI1_CLOCK_RAMP_EXPONENTIAL multiplies the tempo by the same
+ *    ratio every clock, equal musical steps.  That is a constant step
+ *    of the log2 of the period, kept in 8.24.
+ *
+ * The counter ISR runs midi1_clock_ramp_next() and the M0+ has no
+ * divide and no 64 bit multiply, a 64/32 divide per clock would be a
+ * libgcc call of hundreds of cycles.  So the period is found in the log
+ * domain with two small tables: ticks = 2^(log2(numer) - log2(tempo))
+ * for linear, ticks = 2^value for exponential.  Per clock that is an
+ * add, a count leading zeros, two table lookups with a 32 bit multiply
+ * each and shifts, all 32 bit.  The divides are done once when the ramp
+ * starts, the remainder of the per clock step is carried like in
+ * midi1_clock_dds.h so the value never lags the curve by a step or
+ * more.  The period is good to a few ppm, the last clock is at the
+ * target tempo.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_CLOCK_RAMP_H
+#define MIDI1_CLOCK_RAMP_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+enum midi1_clock_ramp_curve {
+	MIDI1_CLOCK_RAMP_LINEAR = 0,
+	MIDI1_CLOCK_RAMP_EXPONENTIAL,
+};
+
+struct midi1_clock_ramp {
+	/* linear: tempo, sbpm 16.16, exponential: log2 of the period 8.24 */
+	uint32_t value;
+	uint32_t target;	/* value at the last clock */
+	int32_t delta;		/* added to value per clock */
+	int32_t step;		/* +1 or -1, carry of the remainder */
+	uint32_t rem;		/* |remainder| of the delta divide */
+	uint32_t acc;		/* carried remainder, always < span */
+	uint32_t span;		/* clocks of the whole ramp */
+	uint32_t log_numer;	/* log2 of period * tempo, 8.24 */
+	uint32_t period;	/* ticks of the last clock */
+	uint32_t clocks;	/* clocks left, 0 when idle */
+	uint8_t curve;		/* enum midi1_clock_ramp_curve */
+};
+
+/* 1.0 in sbpm 16.16, see midi1_clock_ramp_tempo() */
+#define MIDI1_CLOCK_RAMP_TEMPO_ONE (1UL << 16)
+
+/**
+ * @brief Start a ramp.
+ *
+ * @param from period now in ticks
+ * @param to_sbpm target, scaled BPM like 123.12 is 12312
+ * @param clocks length of the ramp, beats * ppqn
+ * @param curve enum midi1_clock_ramp_curve
+ * @param clock_hz counter frequency
+ * @param ppqn clocks per quarter note
+ */
+void midi1_clock_ramp_start(struct midi1_clock_ramp *ramp, uint32_t from,
+			    uint16_t to_sbpm, uint32_t clocks, uint8_t curve,
+			    uint32_t clock_hz, uint8_t ppqn);
+
+/**
+ * @brief Tempo of a period in ticks, sbpm 16.16.
+ */
+uint32_t midi1_clock_ramp_tempo(uint32_t ticks, uint32_t clock_hz,
+				uint8_t ppqn);
+
+/**
+ * @brief Step to the next clock.
+ *
+ * @return its period in ticks, 0 when no ramp is running
+ */
+uint32_t midi1_clock_ramp_next(struct midi1_clock_ramp *ramp);
+
+static inline bool midi1_clock_ramp_active(const struct midi1_clock_ramp *ramp)
+{
+	return ramp->clocks != 0;
+}
+
+/**
+ * @brief Stop where the ramp is now.
+ */
+static inline void midi1_clock_ramp_cancel(struct midi1_clock_ramp *ramp)
+{
+	ramp->clocks = 0;
+}
+
+#endif /* MIDI1_CLOCK_RAMP_H */
+/* EOF */
@@ -0,0 +1,121 @@
+/**
+ * @file midi1_controller.c
+ * @brief 14 bit controller and RPN/NRPN assembly, see midi1_controller.h
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "midi1_defs.h"
+#include "midi1_controller.h"
+
+#define MIDI1_CONTROLLER_MAX 0x3FFF
+
+void midi1_controller_init(struct midi1_controller_state *cs)
+{
+	memset(cs, 0, sizeof(*cs));
+	for (int i = 0; i < 16; i++) {
+		cs->ch[i].param = MIDI1_CONTROLLER_PARAM_NULL;
+	}
+}
+
+/* Parameter number messages only select, they never give an event */
+static void midi1_controller_select(struct midi1_controller_channel *ch,
+				    uint8_t cc, uint8_t v)
+{
+	switch (cc) {
+	case CTL_RPN_MSB:
+	case CTL_NRPN_MSB:
+		ch->param = (v << 7) | (ch->param & MIDI_DATA);
+		break;
+	default:
+		ch->param = (ch->param & (MIDI_DATA << 7)) | v;
+		break;
+	}
+	ch->nrpn = (cc == CTL_NRPN_MSB || cc == CTL_NRPN_LSB);
+	ch->data = 0;
+}
+
+/* Data entry, increment and decrement of the selected parameter */
+static void midi1_controller_data(struct midi1_controller_channel *ch,
+				  uint8_t cc, uint8_t v)
+{
+	switch (cc) {
+	case CTL_MSB_DATA_ENTRY:
+		ch->data = v << 7;
+		break;
+	case CTL_LSB_DATA_ENTRY:
+		ch->data = (ch->data & (MIDI_DATA << 7)) | v;
+		break;
+	case CTL_DATA_INCREMENT:
+		if (ch->data < MIDI1_CONTROLLER_MAX) {
+			ch->data++;
+		}
+		break;
+	default:
+		if (ch->data > 0) {
+			ch->data--;
+		}
+		break;
+	}
+}
+
+bool midi1_controller_assemble(struct midi1_controller_state *cs,
+			       const struct midi1_msg *msg,
+			       struct midi1_msg *out)
+{
+	struct midi1_controller_channel *ch;
+	uint8_t cc = msg->data1;
+	uint8_t v = msg->data2;
+
+	if (msg->type != MIDI1_MSG_CONTROL_CHANGE) {
+		return false;
+	}
+	ch = &cs->ch[msg->status & CHANNEL_MASK];
+	*out = *msg;
+
+	switch (cc) {
+	case CTL_RPN_MSB:
+	case CTL_RPN_LSB:
+	case CTL_NRPN_MSB:
+	case CTL_NRPN_LSB:
+		midi1_controller_select(ch, cc, v);
+		return false;
+	case CTL_MSB_DATA_ENTRY:
+	case CTL_LSB_DATA_ENTRY:
+	case CTL_DATA_INCREMENT:
+	case CTL_DATA_DECREMENT:
+		if (ch->param == MIDI1_CONTROLLER_PARAM_NULL) {
+			/* Plain controller 6/38, increment/decrement nothing */
+			break;
+		}
+		midi1_controller_data(ch, cc, v);
+		out->type = ch->nrpn ? MIDI1_MSG_NRPN : MIDI1_MSG_RPN;
+		out->param = ch->param;
+		out->value = ch->data;
+		return true;
+	default:
+		break;
+	}
+
+	if (cc < CTL_LSB_BANK) {
+		ch->msb[cc] = v;
+		out->type = MIDI1_MSG_CC14;
+		out->param = cc;
+		out->value = v << 7;
+		return true;
+	}
+	if (cc < CTL_LSB_BANK + 32) {
+		out->type = MIDI1_MSG_CC14;
+		out->param = cc - CTL_LSB_BANK;
+		out->value = (ch->msb[cc - CTL_LSB_BANK] << 7) | v;
+		return true;
+	}
+	return false;
+}
+
+/* EOF */
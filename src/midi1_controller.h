@@ -0,0 +1,74 @@
+/**
+ * @file midi1_controller.h
+ * @brief Optional parser stage that assembles 14 bit controllers and
+ * RPN/NRPN parameters from MIDI1.0 control change messages.
+ *
+ * @note
+ * A 14 bit controller is sent as an MSB (controller 0..31) followed by
+ * an LSB (controller 32..63), a parameter as two number and one or two
+ * data entry messages.  This stage keeps the state per channel and turns
+ * them into a single message each time the value changes:
+ *
+ *  - MIDI1_MSG_CC14: param is the controller (0..31), value the 14 bit
+ *    value.  An MSB clears the LSB as the MIDI spec says, so the MSB
+ *    gives an event and the LSB that follows refines it.
+ *  - MIDI1_MSG_RPN / MIDI1_MSG_NRPN: param is the 14 bit parameter
+ *    number, value the data entry value.  Data increment/decrement step
+ *    it by one.  Data entry without a selected parameter (or after the
+ *    null parameter 127/127) is an ordinary CC14 of controller 6.
+ *
+ * So a change sent as MSB and LSB gives two events, deliberately.  Most
+ * senders only send the MSB and nothing tells whether an LSB follows,
+ * holding the MSB back for it would delay every 7 bit controller.  The
+ * second event, from the LSB, has the complete value and replaces the
+ * first.
+ * The control change messages themselves are not consumed here, the
+ * caller still delivers them as they are (see SERIAL_MIDI_EV_ASSEMBLED
+ * in midi1_serial.h for choosing between the two).
+ *
+ * Protocol only, like midi1_parser.h.  The state is 38 bytes per channel.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_CONTROLLER_H
+#define MIDI1_CONTROLLER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+#include "midi1_parser.h"
+
+/* RPN/NRPN 127/127, no parameter selected */
+#define MIDI1_CONTROLLER_PARAM_NULL 0x3FFF
+
+struct midi1_controller_channel {
+	uint8_t msb[32];	/* last MSB of controller 0..31 */
+	uint16_t param;		/* selected parameter number */
+	uint16_t data;		/* data entry value of param */
+	bool nrpn;		/* param is non-registered */
+};
+
+struct midi1_controller_state {
+	struct midi1_controller_channel ch[16];
+};
+
+/**
+ * @brief All controllers 0, no parameter selected.
+ */
+void midi1_controller_init(struct midi1_controller_state *cs);
+
+/**
+ * @brief Feed one message, anything but MIDI1_MSG_CONTROL_CHANGE is
+ * ignored.
+ *
+ * @param out assembled message, only written when true is returned
+ * @return true when the controller completed or changed a 14 bit value
+ */
+bool midi1_controller_assemble(struct midi1_controller_state *cs,
+			       const struct midi1_msg *msg,
+			       struct midi1_msg *out);
+
+#endif /* MIDI1_CONTROLLER_H */
+/* EOF */
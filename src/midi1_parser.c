@@ -0,0 +1,196 @@
+/**
+ * @file midi1_parser.c
+ * @brief MIDI1.0 byte stream parser, see midi1_parser.h
+ *
+ * @note
+ * Table driven: every possible byte is looked up in status_table[] which
+ * tells what kind of message a status byte starts and how many data
+ * bytes follow.  The data bytes are collected and once complete the
+ * message callback is called.  Work per byte is constant, there is no
+ * if/else cascade on the running status.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+#include "midi1_defs.h"
+#include "midi1_parser.h"
+
+struct midi1_status_info {
+	uint8_t type;		/* enum midi1_msg_type */
+	uint8_t len;		/* data bytes following the status */
+};
+
+static const struct midi1_status_info status_table[256] = {
+	[0x00 ... 0x7F] = { MIDI1_MSG_DATA, 0 },
+	[0x80 ... 0x8F] = { MIDI1_MSG_NOTE_OFF, 2 },
+	[0x90 ... 0x9F] = { MIDI1_MSG_NOTE_ON, 2 },
+	[0xA0 ... 0xAF] = { MIDI1_MSG_POLY_AFTERTOUCH, 2 },
+	[0xB0 ... 0xBF] = { MIDI1_MSG_CONTROL_CHANGE, 2 },
+	[0xC0 ... 0xCF] = { MIDI1_MSG_PROGRAM_CHANGE, 1 },
+	[0xD0 ... 0xDF] = { MIDI1_MSG_CHANNEL_AFTERTOUCH, 1 },
+	[0xE0 ... 0xEF] = { MIDI1_MSG_PITCH_WHEEL, 2 },
+	[SYSTEM_EXCLUSIVE_START] = { MIDI1_MSG_SYSTEM_EXCLUSIVE, 0 },
+	[SYSTEM_MTC_QUARTER_FRAME] = { MIDI1_MSG_SYSTEM_COMMON, 1 },
+	[SYSTEM_SONG_POSITION] = { MIDI1_MSG_SYSTEM_COMMON, 2 },
+	[SYSTEM_SONG_SELECT] = { MIDI1_MSG_SYSTEM_COMMON, 1 },
+	[0xF4 ... 0xF5] = { MIDI1_MSG_UNDEFINED, 0 },
+	[SYSTEM_TUNE_REQUEST] = { MIDI1_MSG_SYSTEM_COMMON, 0 },
+	[SYSTEM_EXCLUSIVE_END] = { MIDI1_MSG_SYSTEM_EXCLUSIVE, 0 },
+	[0xF8 ... 0xFF] = { MIDI1_MSG_REALTIME, 0 },
+};
+
+enum midi1_msg_type midi1_msg_type(uint8_t status)
+{
+	return status_table[status].type;
+}
+
+uint8_t midi1_msg_len(uint8_t status)
+{
+	return status_table[status].len;
+}
+
+void midi1_parser_init(struct midi1_parser *ps,
+		       const struct midi1_parser_ops *ops, void *ctx)
+{
+	ps->ops = ops;
+	ps->ctx = ctx;
+	ps->channel_mask = 0xFFFF;
+	ps->running_status = 0;
+	ps->type = MIDI1_MSG_DATA;
+	ps->expected = 0;
+	ps->count = 0;
+	ps->data[0] = 0;
+	ps->data[1] = 0;
+	ps->errors = 0;
+}
+
+static void midi1_parser_message(struct midi1_parser *ps, uint8_t type,
+				 uint8_t status, uint8_t d1, uint8_t d2)
+{
+	struct midi1_msg msg = {
+		.type = type,
+		.status = status,
+		.data1 = d1,
+		.data2 = d2,
+	};
+
+	/*
+	 * A lot of MIDI implementation use velocity zero "note on"
+	 * as a "note-off".  Other do use a note off and the note off velocity
+	 * actually can be used to alter the sound of the note off.
+	 */
+	if (type == MIDI1_MSG_NOTE_ON && d2 == 0) {
+		msg.type = MIDI1_MSG_NOTE_OFF;
+	}
+	ps->ops->message(ps->ctx, &msg);
+}
+
+/* A status byte other than realtime */
+static void midi1_parser_status(struct midi1_parser *ps, uint8_t c,
+				struct midi1_status_info info)
+{
+	const struct midi1_parser_ops *ops = ps->ops;
+
+	if (ps->type == MIDI1_MSG_SYSTEM_EXCLUSIVE && ops->sysex_end != NULL) {
+		/* Any status byte ends the message, normally 0xF7 */
+		ops->sysex_end(ps->ctx, c != SYSTEM_EXCLUSIVE_END);
+	}
+	if (ps->count != 0 || info.type == MIDI1_MSG_UNDEFINED) {
+		/* Previous message cut short, or F4/F5 */
+		ps->errors++;
+	}
+	ps->running_status = c;
+	ps->type = info.type;
+	if (c < SYSTEM_EXCLUSIVE_START &&
+	    !(ps->channel_mask & (1U << (c & CHANNEL_MASK)))) {
+		/*
+		 * Not our channel, the data bytes are still counted so
+		 * running status keeps working but nothing is dispatched.
+		 */
+		ps->type = MIDI1_MSG_FILTERED;
+	}
+	ps->expected = info.len;
+	ps->count = 0;
+	ps->data[1] = 0;
+	if (info.len != 0) {
+		return;
+	}
+
+	/* Tune request, exclusive, undefined */
+	if (c == SYSTEM_EXCLUSIVE_START) {
+		if (ops->sysex_start != NULL) {
+			ops->sysex_start(ps->ctx);
+		}
+		return;
+	}
+	if (info.type == MIDI1_MSG_SYSTEM_COMMON) {
+		midi1_parser_message(ps, info.type, c, 0, 0);
+	}
+	/* 0xF7 and the others leave no running status behind */
+	ps->running_status = 0;
+	ps->type = MIDI1_MSG_DATA;
+}
+
+/*
+ * We parse one byte at a time for the MIDI parsing. Then callback functions are called
+ * for each complete message
+ */
+void midi1_parser_byte(struct midi1_parser *ps, uint8_t c)
+{
+	const struct midi1_status_info info = status_table[c];
+
+	if (info.type == MIDI1_MSG_REALTIME) {
+		/* Realtime may appear anywhere and does not touch the state */
+		midi1_parser_message(ps, MIDI1_MSG_REALTIME, c, 0, 0);
+		return;
+	}
+
+	if (info.type != MIDI1_MSG_DATA) {
+		midi1_parser_status(ps, c, info);
+		return;
+	}
+
+	if (ps->type == MIDI1_MSG_SYSTEM_EXCLUSIVE) {
+		if (ps->ops->sysex_byte != NULL) {
+			ps->ops->sysex_byte(ps->ctx, c);
+		}
+		return;
+	}
+
+	/* Data byte: ignore if there is no (running) status */
+	if (ps->running_status == 0) {
+		ps->errors++;
+		return;
+	}
+
+	ps->data[ps->count++] = c;
+	if (ps->count < ps->expected) {
+		return;
+	}
+	ps->count = 0;
+	if (ps->type != MIDI1_MSG_FILTERED) {
+		midi1_parser_message(ps, ps->type, ps->running_status,
+				     ps->data[0], ps->data[1]);
+	}
+
+	/* Only channel messages have running status */
+	if (ps->running_status >= SYSTEM_EXCLUSIVE_START) {
+		ps->running_status = 0;
+		ps->type = MIDI1_MSG_DATA;
+	}
+}
+
+void midi1_parser_bytes(struct midi1_parser *ps, const uint8_t *data,
+			size_t len)
+{
+	for (size_t i = 0; i < len; i++) {
+		midi1_parser_byte(ps, data[i]);
+	}
+}
+
+/* EOF */
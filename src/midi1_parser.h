@@ -0,0 +1,136 @@
+/**
+ * @file midi1_parser.h
+ * @brief MIDI1.0 byte stream parser, protocol only.
+ *
+ * @note
+ * The state machine that used to live in midi1_serial.c.  It knows
+ * nothing about UARTs, threads or Zephyr kernel objects so the same code
+ * runs on the target and on native_sim/Linux.  Feed it bytes with
+ * midi1_parser_byte() or midi1_parser_bytes(), complete messages and
+ * system exclusive data come out through the callbacks in
+ * struct midi1_parser_ops.
+ *
+ * It handles running status, realtime bytes in the middle of other
+ * messages, a receive channel mask and system exclusive messages cut
+ * short by another status byte.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_PARSER_H
+#define MIDI1_PARSER_H
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/**
+ * @brief Message type of a status byte.
+ *
+ * The complete message types come first, the channel ones in the order
+ * of their status nibble (0x8n is MIDI1_MSG_NOTE_OFF).
+ */
+enum midi1_msg_type {
+	MIDI1_MSG_NOTE_OFF = 0,
+	MIDI1_MSG_NOTE_ON,
+	MIDI1_MSG_POLY_AFTERTOUCH,
+	MIDI1_MSG_CONTROL_CHANGE,
+	MIDI1_MSG_PROGRAM_CHANGE,
+	MIDI1_MSG_CHANNEL_AFTERTOUCH,
+	MIDI1_MSG_PITCH_WHEEL,
+	MIDI1_MSG_SYSTEM_COMMON,	/* F1, F2, F3, F6 */
+	MIDI1_MSG_REALTIME,		/* F8..FF */
+	/* Assembled from controllers by midi1_controller.h, not the parser */
+	MIDI1_MSG_CC14,			/* 14 bit controller 0..31 */
+	MIDI1_MSG_RPN,			/* registered parameter */
+	MIDI1_MSG_NRPN,			/* non-registered parameter */
+	/* Below are never handed to the message callback */
+	MIDI1_MSG_SYSTEM_EXCLUSIVE,	/* F0, F7 */
+	MIDI1_MSG_UNDEFINED,		/* F4, F5 */
+	MIDI1_MSG_DATA,			/* 0x00..0x7F, not a status byte */
+	MIDI1_MSG_FILTERED,		/* channel message not listened to */
+	MIDI1_MSG_TYPE_COUNT
+};
+
+/**
+ * @brief A complete message.  A note on with velocity 0 has type
+ * MIDI1_MSG_NOTE_OFF but keeps its 0x9n status.  Unused data bytes are 0.
+ *
+ * param and value are only used by the assembled types: the controller
+ * (0..31) or the 14 bit parameter number and the 14 bit value.  data1
+ * and data2 are then the controller message that completed it.
+ */
+struct midi1_msg {
+	uint8_t type;		/* enum midi1_msg_type */
+	uint8_t status;
+	uint8_t data1;
+	uint8_t data2;
+	uint16_t param;
+	uint16_t value;
+};
+
+/**
+ * @brief Parser callbacks, ctx is the pointer given to
+ * midi1_parser_init().  The system exclusive ones may be NULL.
+ */
+struct midi1_parser_ops {
+	/* Complete channel, system common or realtime message */
+	void (*message)(void *ctx, const struct midi1_msg *msg);
+	/* 0xF0 received */
+	void (*sysex_start)(void *ctx);
+	/* One data byte of a system exclusive message */
+	void (*sysex_byte)(void *ctx, uint8_t c);
+	/* 0xF7 received, or 'aborted' when another status byte ended it */
+	void (*sysex_end)(void *ctx, bool aborted);
+};
+
+/**
+ * @brief Parser state, one per input stream.
+ */
+struct midi1_parser {
+	const struct midi1_parser_ops *ops;
+	void *ctx;
+	/* Channels listened to, bit n is channel n */
+	uint16_t channel_mask;
+	uint8_t running_status;
+	uint8_t type;		/* enum midi1_msg_type of running_status */
+	uint8_t expected;	/* data bytes of the current message */
+	uint8_t count;		/* data bytes collected */
+	uint8_t data[2];
+	/*
+	 * Bytes that did not fit: data without status, undefined status
+	 * bytes and messages cut short by a new status byte.
+	 */
+	uint32_t errors;
+};
+
+/**
+ * @brief Reset the parser, listens to all channels.
+ */
+void midi1_parser_init(struct midi1_parser *ps,
+		       const struct midi1_parser_ops *ops, void *ctx);
+
+/**
+ * @brief Parse one byte.
+ */
+void midi1_parser_byte(struct midi1_parser *ps, uint8_t c);
+
+/**
+ * @brief Parse a buffer, same as midi1_parser_byte() for every byte.
+ */
+void midi1_parser_bytes(struct midi1_parser *ps, const uint8_t *data,
+			size_t len);
+
+/**
+ * @brief Message type of a status byte.
+ */
+enum midi1_msg_type midi1_msg_type(uint8_t status);
+
+/**
+ * @brief Number of data bytes following a status byte.
+ */
+uint8_t midi1_msg_len(uint8_t status);
+
+#endif /* MIDI1_PARSER_H */
+/* EOF */
@@ -10,89 +10,411 @@
  * playing latency. It's essential when working with real gear. 
  * 
  *  The MIDI USART implementation for the Zephyr RTOS
- *  and uses the ring buffer and UART driver.
+ *  and uses the ring buffer and UART driver.  Transmit is interrupt
+ *  driven: senders only queue bytes, they never wait for the UART.
  * 
- *  TODO:  - Change the parser to accept a MIDI channel number or OMNI mode. 
- * - Error handling for the parser right now it's ignored. 
+ *  Received bytes can be traced with MIDI1_SERIAL_TRACE, see
+ *  midi1_serial_trace.h, printing them per byte stalls the parser.
+ *
+ *  When a DIN output can not keep up, controller, pitch wheel and
+ *  aftertouch messages are coalesced: only the latest value is sent.
+ *  Notes and realtime bytes are never dropped for that, and nothing
+ *  overtakes a parked value of its own channel.
+ *
+ *  Realtime bytes are split off in the RX ISR, they never wait behind
+ *  note or system exclusive data.  See SerialMidiSetRealtimeHook().
+ *
+ *  The receive parser is midi1_parser.c, table driven and without any
+ *  Zephyr dependency so it also runs on the host.  Complete messages are
+ *  delivered as timestamped events to any number of listeners, one by
+ *  one or batched per wakeup, see SerialMidiAddListener().  System exclusive
+ *  messages are streamed in chunks to a consumer, see
+ *  SerialMidiSetSysexHandler().
+ *
+ *  Channel messages are filtered per port with a channel mask, OMNI is
+ *  all channels.  See SerialMidiSetChannelMask().
+ *
+ *  Listeners that ask for SERIAL_MIDI_EV_ASSEMBLED types get 14 bit
+ *  controllers and RPN/NRPN parameters as one event, see
+ *  midi1_controller.h.
+ *
+ *  TODO: - Error handling for the parser right now it's only counted.
  *
  * Created in 2014 ported to Zephyr RTOS in 2024. 
  * @author Jan-Willem Smaal <usenet@gispen.org> 
  * @updated 20241224
  * @updated 20260103
+ * @updated 20261016 interrupt driven TX queue, ring buffer RX,
+ *          table driven parser
  * @license SPDX-License-Identifier: Apache-2.0
  */
 #include <zephyr/kernel.h>
 #include <zephyr/device.h>
 #include <zephyr/drivers/uart.h>
 #include <zephyr/sys/ring_buffer.h>
+#include <string.h>
 
 #include "midi1_serial.h"
 #include "midi1.h"
+#include "midi1_clock_measure_counter.h"
+#include "midi1_controller.h"
+#if MIDI1_SERIAL_TRACE
+#include "midi1_serial_trace.h"
+#endif
+
+/* Chunks for streaming system exclusive messages to the consumer */
+K_MEM_SLAB_DEFINE_STATIC(midi_sysex_slab, sizeof(struct serial_midi_sysex_chunk),
+			 MIDI1_SERIAL_SYSEX_CHUNKS, 4);
+
+#define SERIAL_MIDI_TX_DELAY_BUCKETS					\
+	(MIDI1_SERIAL_TX_QUEUE_SIZE / MIDI1_SERIAL_TX_DELAY_BUCKET_BYTES + 1)
+
+/* A controller style message waiting for the link to get quiet */
+struct serial_midi_coalesce_slot {
+	uint8_t status;
+	uint8_t key;		/* controller number, 0 for pitch/aftertouch */
+	uint8_t d1;
+	uint8_t d2;
+	uint8_t len;
+	bool refresh;
+};
+
+/*
+ * One DIN port.  Everything that used to be a file scope global lives
+ * here so several UARTs can be served by the same code and thread.
+ */
+struct serial_midi_port {
+	const struct device *dev;
+	bool ready;
+
+	/*
+	 * Transmit queue.  The senders copy complete messages into the ring
+	 * buffer and return, the UART TX interrupt moves the bytes into the
+	 * UART FIFO.  This way a note on costs a few microseconds instead of
+	 * busy-waiting ~1 ms for three bytes at 31250 baud.
+	 *
+	 * The running status decision and the enqueue are done under one
+	 * lock so that senders in different threads never interleave their
+	 * bytes.
+	 */
+	struct ring_buf tx_ringbuf;
+	uint8_t tx_buf[MIDI1_SERIAL_TX_QUEUE_SIZE];
+	struct k_spinlock tx_lock;
+	struct k_sem tx_space_sem;
+	enum serial_midi_tx_policy tx_policy;
+	uint8_t running_status_tx;
+	uint8_t running_status_tx_count;	/* messages sent under it */
+	bool note_off_as_note_on;
+
+	/*
+	 * Realtime lane, filled by the senders under tx_lock and emptied by
+	 * the TX interrupt before it takes anything from tx_ringbuf.
+	 */
+	uint8_t tx_rt[MIDI1_SERIAL_TX_RT_QUEUE_SIZE];
+#if MIDI1_SERIAL_TX_RT_MEASURE
+	uint32_t tx_rt_cycles[MIDI1_SERIAL_TX_RT_QUEUE_SIZE];
+#endif
+	uint32_t tx_rt_in;
+	uint32_t tx_rt_out;
+	/*
+	 * A Continue queued in tx_ringbuf behind a song position: the lane
+	 * entries from tx_rt_hold_at on wait until the tx_rt_hold ring
+	 * bytes up to and including that Continue have gone out.
+	 */
+	uint32_t tx_rt_hold;
+	uint32_t tx_rt_hold_at;
+	/*
+	 * TX delay measurement: tx_seq_in/out count the bytes put in and
+	 * taken out of tx_ringbuf (sent or dropped), a stamp holds the
+	 * sequence number of the first byte of a message and the cycle
+	 * counter when it was queued.
+	 */
+	struct {
+		uint32_t seq;
+		uint32_t cycles;
+	} tx_stamp[MIDI1_SERIAL_TX_DELAY_STAMPS];
+	uint32_t tx_stamp_in;
+	uint32_t tx_stamp_out;
+	uint32_t tx_seq_in;
+	uint32_t tx_seq_out;
+
+	/*
+	 * Controller style messages waiting while the link is busy, in the
+	 * order they were first queued.  Filled by the senders, flushed into
+	 * tx_ringbuf by the TX interrupt, both under tx_lock.
+	 */
+	struct serial_midi_coalesce_slot coalesce[MIDI1_SERIAL_COALESCE_SLOTS];
+	uint8_t coalesce_count;
+
+	/*
+	 * Receive ring buffer, single producer (ISR) single consumer
+	 * (parser thread) so no locking is needed.
+	 */
+	struct ring_buf rx_ringbuf;
+	uint8_t rx_buf[MIDI1_SERIAL_RX_QUEUE_SIZE];
+
+	/*
+	 * Realtime bytes with the measurement counter value at which the
+	 * ISR saw them.  The ISR only writes rt_in and the parser thread
+	 * only writes rt_out.
+	 */
+	struct {
+		uint32_t timestamp;
+		uint8_t msg;
+	} rt_queue[MIDI1_SERIAL_RT_QUEUE_SIZE];
+	uint32_t rt_in;
+	uint32_t rt_out;
+
+	/* Receive state machine, also holds the channel mask */
+	struct midi1_parser parser;
+	/* 14 bit controller and RPN/NRPN assembly */
+	struct midi1_controller_state controllers;
+	struct serial_midi_sysex_chunk *sysex_chunk;
+	uint8_t sysex_flags;
+
+	/*
+	 * Listeners for the received messages.  Events for batched
+	 * listeners are collected in 'batch' during one drain.
+	 */
+	sys_slist_t listeners;
+	uint32_t listener_types;	/* types of the normal listeners */
+	uint32_t batched_types;		/* types of the batched listeners */
+	struct serial_midi_event batch[MIDI1_SERIAL_EVENT_BATCH];
+	uint8_t batch_count;
+	uint8_t index;
+	/* Measurement counter at the last RX interrupt that read data */
+	uint32_t rx_timestamp;
 
-#define MSGQ_SIZE 128
-#define MSG_SIZE sizeof(uint8_t)
-K_MSGQ_DEFINE(midi_msgq, MSG_SIZE, MSGQ_SIZE, 4);
+	void (*realtime_hook)(uint8_t msg, uint32_t timestamp);
+#if MIDI1_SERIAL_TX_TAP
+	void (*tx_tap)(uint8_t port, uint8_t c);
+#endif
+	void (*sysex_delegate)(struct serial_midi_sysex_chunk *chunk);
 
-/*-----------------------------------------------------------------------*/
-/* Global variables */
-static uint8_t global_running_status_tx;
-static uint8_t global_running_status_tx_count;
-static uint8_t global_running_status_rx;
-static uint8_t global_3rd_byte_flag;
-static uint8_t global_midi_c2;
-static uint8_t global_midi_c3;
+	struct serial_midi_stats stats;
+
+	/* Measured TX queueing delay histogram, utilization bookkeeping */
+	uint32_t tx_delay_hist[SERIAL_MIDI_TX_DELAY_BUCKETS];
+	uint32_t util_tx_last;
+	uint32_t util_rx_last;
+	uint32_t util_tx_q8;
+	uint32_t util_rx_q8;
+};
 
 /* 
- * Make sure there is a  "midi" in the device tree overlay. 
- * We'll cover the multi port MIDI stuff later. for now just one MIDI port is 
- * supported per board.   Also this is a UART device so make sure the UART
- * is enabled in the device prj.conf
- */
-#define UART_DEVICE_NODE DT_ALIAS(midi)
-static const struct device *const midi = DEVICE_DT_GET(UART_DEVICE_NODE);
-
-/*-----------------------------------------------------------------------*/
-/* Global Function pointers for the delegate/callbacks */
-void (*midi_note_on_delegate)(uint8_t note, uint8_t velocity);
-void (*midi_note_off_delegate)(uint8_t note, uint8_t velocity);
-void (*midi_control_change_delegate)(uint8_t controller, uint8_t value);
-void (*realtime_handler_delegate)(uint8_t msg);
-void (*midi_pitchwheel_delegate)(uint8_t lsb, uint8_t msb);
+ * The ports come from the device tree aliases "midi", "midi1", "midi2"
+ * and "midi3" (in that order, port 0 is "midi").  Aliases that are not in
+ * the overlay or have their UART disabled are skipped.  Also this is a
+ * UART device so make sure the UART is enabled in the device prj.conf
+ */
+#define SERIAL_MIDI_PORT_DEV(alias)					\
+	IF_ENABLED(DT_NODE_HAS_STATUS(DT_ALIAS(alias), okay),		\
+		   (DEVICE_DT_GET(DT_ALIAS(alias)),))
+
+static const struct device *const serial_midi_devs[] = {
+	FOR_EACH(SERIAL_MIDI_PORT_DEV, (), SERIAL_MIDI_PORT_ALIASES)
+};
+
+#define SERIAL_MIDI_NUM_PORTS ARRAY_SIZE(serial_midi_devs)
+BUILD_ASSERT(IS_POWER_OF_TWO(MIDI1_SERIAL_RT_QUEUE_SIZE),
+	     "MIDI1_SERIAL_RT_QUEUE_SIZE must be a power of two");
+BUILD_ASSERT(IS_POWER_OF_TWO(MIDI1_SERIAL_TX_RT_QUEUE_SIZE),
+	     "MIDI1_SERIAL_TX_RT_QUEUE_SIZE must be a power of two");
+BUILD_ASSERT(SERIAL_MIDI_EV_COUNT <= 32, "type masks are 32 bits");
+BUILD_ASSERT(MIDI1_SERIAL_EVENT_BATCH <= UINT8_MAX);
+BUILD_ASSERT(SERIAL_MIDI_NUM_PORTS > 0,
+	     "No MIDI UART, add a \"midi\" alias to the device tree overlay");
+
+static struct serial_midi_port serial_midi_ports[SERIAL_MIDI_NUM_PORTS];
+static const struct midi1_parser_ops serial_midi_parser_ops;
+
+/*
+ * All ports share one parser thread.  Every RX interrupt gives this
+ * semaphore, the thread then drains the RX rings of all ports.
+ */
+K_SEM_DEFINE(midi_rx_sem, 0, 1);
+
+/*
+ * Rolling utilization: bytes moved in the last period as a percentage of
+ * what the link can carry, smoothed with weight 1/4 in 8.8 fixed point.
+ * Runs from the timer so the byte path only has to count.
+ */
+static uint32_t serial_midi_util_update(uint32_t *q8, uint32_t *last,
+					uint32_t bytes)
+{
+	uint32_t pct = (bytes - *last) * 100U * 1000U /
+		       (MIDI1_SERIAL_BYTES_PER_SEC * MIDI1_SERIAL_UTIL_PERIOD_MS);
+
+	*last = bytes;
+	if (pct > 100) {
+		pct = 100;
+	}
+	*q8 = *q8 - (*q8 >> 2) + ((pct << 8) >> 2);
+	return (*q8 + 128) >> 8;
+}
+
+static void serial_midi_util_timer_fn(struct k_timer *timer)
+{
+	for (uint8_t port = 0; port < SERIAL_MIDI_NUM_PORTS; port++) {
+		struct serial_midi_port *p = &serial_midi_ports[port];
+
+		if (!p->ready) {
+			continue;
+		}
+		p->stats.tx_utilization =
+		    serial_midi_util_update(&p->util_tx_q8, &p->util_tx_last,
+					    p->stats.tx_bytes);
+		p->stats.rx_utilization =
+		    serial_midi_util_update(&p->util_rx_q8, &p->util_rx_last,
+					    p->stats.rx_bytes);
+	}
+}
+
+K_TIMER_DEFINE(serial_midi_util_timer, serial_midi_util_timer_fn, NULL);
+static bool serial_midi_util_started;
+
+static struct serial_midi_port *serial_midi_port_get(uint8_t port)
+{
+	if (port >= SERIAL_MIDI_NUM_PORTS) {
+		return NULL;
+	}
+	return &serial_midi_ports[port];
+}
+
+uint8_t SerialMidiNumPorts(void)
+{
+	return SERIAL_MIDI_NUM_PORTS;
+}
+
+/* Type masks of the listeners, kept so the parser can skip work */
+static void serial_midi_listener_types(struct serial_midi_port *p)
+{
+	struct serial_midi_listener *l;
+
+	p->listener_types = 0;
+	p->batched_types = 0;
+	SYS_SLIST_FOR_EACH_CONTAINER(&p->listeners, l, node) {
+		if (l->batched) {
+			p->batched_types |= l->type_mask;
+		} else {
+			p->listener_types |= l->type_mask;
+		}
+	}
+}
+
+int SerialMidiAddListener(uint8_t port, struct serial_midi_listener *listener)
+{
+	struct serial_midi_port *p = serial_midi_port_get(port);
+
+	if (p == NULL) {
+		return -ENODEV;
+	}
+	if (listener == NULL || listener->fn == NULL) {
+		return -EINVAL;
+	}
+	sys_slist_append(&p->listeners, &listener->node);
+	serial_midi_listener_types(p);
+	return 0;
+}
+
+int SerialMidiRemoveListener(uint8_t port,
+			     struct serial_midi_listener *listener)
+{
+	struct serial_midi_port *p = serial_midi_port_get(port);
+
+	if (p == NULL) {
+		return -ENODEV;
+	}
+	if (!sys_slist_find_and_remove(&p->listeners, &listener->node)) {
+		return -ENOENT;
+	}
+	serial_midi_listener_types(p);
+	return 0;
+}
+
+void SerialMidiSetSysexHandler(uint8_t port,
+			       void (*sysex_handler_ptr)(struct serial_midi_sysex_chunk *chunk))
+{
+	struct serial_midi_port *p = serial_midi_port_get(port);
+
+	if (p) {
+		p->sysex_delegate = sysex_handler_ptr;
+	}
+}
+
+void SerialMidiSysexChunkFree(struct serial_midi_sysex_chunk *chunk)
+{
+	k_mem_slab_free(&midi_sysex_slab, chunk);
+}
+
+void SerialMidiSetRealtimeHook(uint8_t port,
+			       void (*realtime_hook_ptr)(uint8_t msg,
+							 uint32_t timestamp))
+{
+	struct serial_midi_port *p = serial_midi_port_get(port);
+
+	if (p) {
+		p->realtime_hook = realtime_hook_ptr;
+	}
+}
+
+#if MIDI1_SERIAL_TX_TAP
+void SerialMidiSetTxTap(uint8_t port,
+			void (*tx_tap_ptr)(uint8_t port, uint8_t c))
+{
+	struct serial_midi_port *p = serial_midi_port_get(port);
+
+	if (p) {
+		p->tx_tap = tx_tap_ptr;
+	}
+}
+#endif
 
 /**
- * Inits the serial USART with MIDI clock speed and 
- * registers delegates for the callbacks.
- */
-void SerialMidiInit(void (*note_on_handler_ptr)(uint8_t note, uint8_t velocity),
-		    void(*note_off_handler_ptr)(uint8_t note, uint8_t velocity),
-		    void(*control_change_handler_ptr)(uint8_t controller,
-						      uint8_t value),
-		    void(*realtime_handler_delegate_ptr)(uint8_t msg),
-		    void(*midi_pitchwheel_delegate_ptr)(uint8_t lsb,
-							uint8_t msb))
-{
-	/* Assign delegate's */
-	midi_note_on_delegate =(void *)note_on_handler_ptr;
-	midi_note_off_delegate = (void *)note_off_handler_ptr;
-	midi_control_change_delegate = (void *)control_change_handler_ptr;
-	realtime_handler_delegate = (void *)realtime_handler_delegate_ptr;
-	midi_pitchwheel_delegate = (void *)midi_pitchwheel_delegate_ptr;
-
-	/* Init the receive state machine */
-	global_running_status_tx = 0;
-	global_running_status_tx_count = 0;
-	global_running_status_rx = 0;
-	global_3rd_byte_flag = 0;
-	global_midi_c2 = 0;
-	global_midi_c3 = 0;
-
-	/* TODO add Zephyr specific init stuff */
-	if (!device_is_ready(midi)) {
+ * Inits the serial USART with MIDI clock speed, the received messages
+ * go to the listeners added with SerialMidiAddListener().
+ */
+void SerialMidiInit(uint8_t port)
+{
+	struct serial_midi_port *p = serial_midi_port_get(port);
+
+	if (p == NULL) {
+		printk("MIDI port %u does not exist\n", port);
+		return;
+	}
+	p->dev = serial_midi_devs[port];
+	p->index = port;
+
+	/* Init the queues and the receive state machine */
+	ring_buf_init(&p->tx_ringbuf, sizeof(p->tx_buf), p->tx_buf);
+	ring_buf_init(&p->rx_ringbuf, sizeof(p->rx_buf), p->rx_buf);
+	k_sem_init(&p->tx_space_sem, 0, 1);
+	p->tx_policy = MIDI1_SERIAL_TX_POLICY;
+	p->running_status_tx = 0;
+	p->running_status_tx_count = 0;
+	p->note_off_as_note_on = false;
+	p->tx_rt_in = 0;
+	p->tx_rt_out = 0;
+	p->tx_rt_hold = 0;
+	p->tx_stamp_in = 0;
+	p->tx_stamp_out = 0;
+	p->tx_seq_in = 0;
+	p->tx_seq_out = 0;
+	p->coalesce_count = 0;
+	midi1_parser_init(&p->parser, &serial_midi_parser_ops, p);
+	p->parser.channel_mask = SERIAL_MIDI_OMNI;
+	midi1_controller_init(&p->controllers);
+	p->sysex_chunk = NULL;
+	p->batch_count = 0;
+	p->rt_in = 0;
+	p->rt_out = 0;
+
+	if (!device_is_ready(p->dev)) {
 		printk("UART device not found!");
 		return;
 	}
 	int ret =
-	    uart_irq_callback_user_data_set(midi, serial_isr_callback, NULL);
+	    uart_irq_callback_user_data_set(p->dev, serial_isr_callback, p);
 	if (ret < 0) {
 		if (ret == -ENOTSUP) {
 			printk
@@ -105,73 +427,528 @@ void SerialMidiInit(void (*note_on_handler_ptr)(uint8_t note, uint8_t velocity),
 		}
 		return;
 	}
-	uart_irq_rx_enable(midi);
+	p->ready = true;
+	uart_irq_rx_enable(p->dev);
+
+	if (!serial_midi_util_started) {
+		serial_midi_util_started = true;
+		k_timer_start(&serial_midi_util_timer,
+			      K_MSEC(MIDI1_SERIAL_UTIL_PERIOD_MS),
+			      K_MSEC(MIDI1_SERIAL_UTIL_PERIOD_MS));
+	}
 }
 
-/* 
- * All functions related to sending MIDI messages to the serial USART
+void SerialMidiSetChannelMask(uint8_t port, uint16_t channel_mask)
+{
+	struct serial_midi_port *p = serial_midi_port_get(port);
+
+	if (p) {
+		p->parser.channel_mask = channel_mask;
+	}
+}
+
+void SerialMidiSetTxPolicy(uint8_t port, enum serial_midi_tx_policy policy)
+{
+	struct serial_midi_port *p = serial_midi_port_get(port);
+
+	if (p) {
+		p->tx_policy = policy;
+	}
+}
+
+void SerialMidiSetNoteOffAsNoteOn(uint8_t port, bool enable)
+{
+	struct serial_midi_port *p = serial_midi_port_get(port);
+
+	if (p) {
+		p->note_off_as_note_on = enable;
+	}
+}
+
+/*
+ * Upper edge in us of the histogram bucket holding the given per mille
+ * of all messages.
  */
-void SerialMidiNoteON(uint8_t channel, uint8_t key, uint8_t velocity)
+static uint32_t serial_midi_delay_percentile(const uint32_t *hist,
+					     uint32_t total, uint32_t permille)
 {
-	if ((C_NOTE_ON | channel) != global_running_status_tx) {
-		uart_poll_out(midi, C_NOTE_ON | channel);
-		global_running_status_tx = C_NOTE_ON | channel;
+	uint32_t target = (total * permille + 999U) / 1000U;
+	uint32_t sum = 0;
+	uint32_t i;
+
+	for (i = 0; i < SERIAL_MIDI_TX_DELAY_BUCKETS - 1; i++) {
+		sum += hist[i];
+		if (sum >= target) {
+			break;
+		}
 	}
-	uart_poll_out(midi, key);
-	uart_poll_out(midi, velocity);
+	return (i + 1) * MIDI1_SERIAL_TX_DELAY_BUCKET_BYTES *
+	       MIDI1_SERIAL_US_PER_BYTE;
 }
 
-void SerialMidiNoteOFF(uint8_t channel, uint8_t key, uint8_t velocity)
+/*
+ * Lock free snapshot, the counters are copied as they are and the
+ * percentiles are worked out here so the byte path only increments.
+ */
+void SerialMidiGetStats(uint8_t port, struct serial_midi_stats *stats)
 {
-	if ((C_NOTE_ON | channel) != global_running_status_tx) {
-		uart_poll_out(midi, C_NOTE_OFF | channel);
-		global_running_status_tx = C_NOTE_OFF | channel;
+	struct serial_midi_port *p = serial_midi_port_get(port);
+	uint32_t hist[SERIAL_MIDI_TX_DELAY_BUCKETS];
+	uint32_t total = 0;
+
+	if (p == NULL) {
+		return;
 	}
-	uart_poll_out(midi, key);
-	uart_poll_out(midi, velocity);
+	*stats = p->stats;
+	stats->rx_parse_errors = p->parser.errors;
+
+	for (uint32_t i = 0; i < SERIAL_MIDI_TX_DELAY_BUCKETS; i++) {
+		hist[i] = p->tx_delay_hist[i];
+		total += hist[i];
+	}
+	if (total == 0) {
+		stats->tx_delay_p50_us = 0;
+		stats->tx_delay_p90_us = 0;
+		stats->tx_delay_p99_us = 0;
+		return;
+	}
+	stats->tx_delay_p50_us = serial_midi_delay_percentile(hist, total, 500);
+	stats->tx_delay_p90_us = serial_midi_delay_percentile(hist, total, 900);
+	stats->tx_delay_p99_us = serial_midi_delay_percentile(hist, total, 990);
 }
 
-void SerialMidiControlChange(uint8_t channel, uint8_t controller, uint8_t val)
+/*
+ * DROP_OLDEST: throw away queued messages until there is room for
+ * 'needed' bytes _and_ the queue starts with a status byte again.  Data
+ * bytes left at the head would otherwise be interpreted with whatever
+ * running status the receiver has.  Every status byte thrown away counts
+ * as a dropped message.  A realtime byte in the ring (a Continue behind
+ * its song position, see serial_midi_tx_then()) and the bytes ahead of
+ * it are never dropped, returns false when they are in the way.  Caller
+ * holds p->tx_lock.
+ */
+static bool serial_midi_tx_drop_oldest(struct serial_midi_port *p,
+				       uint32_t needed)
 {
+	bool dropped = false;
+	uint8_t c;
+
+	while (ring_buf_space_get(&p->tx_ringbuf) < needed) {
+		if (p->tx_rt_hold != 0 ||
+		    ring_buf_peek(&p->tx_ringbuf, &c, 1) != 1 ||
+		    c >= RT_TIMING_CLOCK) {
+			break;
+		}
+		if (c & CHANNEL_VOICE_MASK) {
+			p->stats.tx_dropped++;
+		}
+		ring_buf_get(&p->tx_ringbuf, NULL, 1);
+		p->tx_seq_out++;
+		dropped = true;
+	}
+	if (dropped) {
+		/* The rest of a message cut in half, up to the next status */
+		while (ring_buf_peek(&p->tx_ringbuf, &c, 1) == 1 &&
+		       !(c & CHANNEL_VOICE_MASK)) {
+			ring_buf_get(&p->tx_ringbuf, NULL, 1);
+			p->tx_seq_out++;
+		}
+		/* The status byte that was in effect may be gone, send it again */
+		p->running_status_tx = 0;
+	}
+	return ring_buf_space_get(&p->tx_ringbuf) >= needed;
+}
+
+/*
+ * Queue a realtime byte in the realtime lane.  A clock that can not go
+ * out now is of no use later, so a full lane drops it whatever the TX
+ * policy is.
+ */
+static int serial_midi_tx_realtime(struct serial_midi_port *p, uint8_t msg)
+{
+	k_spinlock_key_t key = k_spin_lock(&p->tx_lock);
+	uint32_t idx;
+
+	if (p->tx_rt_in - p->tx_rt_out >= MIDI1_SERIAL_TX_RT_QUEUE_SIZE) {
+		p->stats.tx_rt_dropped++;
+		k_spin_unlock(&p->tx_lock, key);
+		return -ENOBUFS;
+	}
+	idx = p->tx_rt_in & (MIDI1_SERIAL_TX_RT_QUEUE_SIZE - 1);
+	p->tx_rt[idx] = msg;
+#if MIDI1_SERIAL_TX_RT_MEASURE
+	p->tx_rt_cycles[idx] = k_cycle_get_32();
+#endif
+	p->tx_rt_in++;
+	uart_irq_tx_enable(p->dev);
+	k_spin_unlock(&p->tx_lock, key);
+
+	return 0;
+}
+
+/*
+ * Put one complete message in the TX ring if it fits.  The status byte
+ * is left out when it matches the running status.  With 'refresh' set
+ * it is sent anyway once 16 messages went out under it, so a receiver
+ * that lost it gets back in sync.  The count is kept here under the
+ * lock, a decision taken before it could be stale.  System common (0xF0..0xF7) status bytes never match the
+ * running status so they are always sent.  A note off becomes a note on
+ * with velocity 0 here when the port asks for it, the running status it
+ * keeps is only known under the lock.  Caller holds p->tx_lock.
+ */
+static bool serial_midi_tx_put(struct serial_midi_port *p, uint8_t status,
+			       uint8_t d1, uint8_t d2, uint8_t len,
+			       bool refresh)
+{
+	uint8_t msg[3];
+	uint8_t n = 0;
+	uint32_t ahead;
+	bool note_off = false;
+
+	if ((status & ~CHANNEL_MASK) == C_NOTE_OFF && p->note_off_as_note_on) {
+		status = C_NOTE_ON | (status & CHANNEL_MASK);
+		d2 = 0;
+		note_off = true;
+	}
+	if (status != p->running_status_tx ||
+	    (refresh && p->running_status_tx_count >= 16)) {
+		msg[n++] = status;
+	}
+	if (len > 0) {
+		msg[n++] = d1;
+	}
+	if (len > 1) {
+		msg[n++] = d2;
+	}
+	if (ring_buf_space_get(&p->tx_ringbuf) < n) {
+		return false;
+	}
+
+	ahead = ring_buf_size_get(&p->tx_ringbuf);
+	if (p->tx_stamp_in - p->tx_stamp_out < MIDI1_SERIAL_TX_DELAY_STAMPS) {
+		uint32_t idx = p->tx_stamp_in & (MIDI1_SERIAL_TX_DELAY_STAMPS - 1);
+
+		p->tx_stamp[idx].seq = p->tx_seq_in;
+		p->tx_stamp[idx].cycles = k_cycle_get_32();
+		p->tx_stamp_in++;
+	}
+	p->tx_seq_in += n;
+	if (ahead + n > p->stats.tx_queue_high_water) {
+		p->stats.tx_queue_high_water = ahead + n;
+	}
+	if (msg[0] != status) {
+		p->stats.tx_running_status_saved++;
+		if (note_off) {
+			/* A note off status would have broken it */
+			p->stats.tx_note_off_saved++;
+		}
+	}
+	ring_buf_put(&p->tx_ringbuf, msg, n);
+	if (msg[0] == status) {
+		p->running_status_tx_count = 1;
+	} else if (p->running_status_tx_count < UINT8_MAX) {
+		p->running_status_tx_count++;
+	}
+	if (status < SYSTEM_EXCLUSIVE_START) {
+		p->running_status_tx = status;
+	} else {
+		/* System common messages cancel running status */
+		p->running_status_tx = 0;
+	}
+	uart_irq_tx_enable(p->dev);
+	return true;
+}
+
+/*
+ * Move the parked messages of the channel of 'status' into the TX ring,
+ * whatever the threshold, so a message that is not coalesced never
+ * overtakes them.  Returns false when the ring got full first, the rest
+ * stays parked in order.  Caller holds p->tx_lock.
+ */
+static bool serial_midi_coalesce_flush_channel(struct serial_midi_port *p,
+					       uint8_t status)
+{
+	const uint8_t channel = status & CHANNEL_MASK;
+	uint8_t kept = 0;
+	bool room = true;
+
+	if (p->coalesce_count == 0 || status >= SYSTEM_EXCLUSIVE_START) {
+		return true;
+	}
+	for (uint8_t i = 0; i < p->coalesce_count; i++) {
+		const struct serial_midi_coalesce_slot *slot = &p->coalesce[i];
+
+		if (room && (slot->status & CHANNEL_MASK) == channel) {
+			room = serial_midi_tx_put(p, slot->status, slot->d1,
+						  slot->d2, slot->len,
+						  slot->refresh);
+			if (room) {
+				continue;
+			}
+		}
+		if (kept != i) {
+			p->coalesce[kept] = *slot;
+		}
+		kept++;
+	}
+	p->coalesce_count = kept;
+	return room;
+}
+
+/*
+ * Queue one complete message, what happens when it does not fit depends
+ * on the TX policy.  Realtime bytes (0xF8..0xFF) go to the realtime lane.
+ * Parked messages of the same channel go first.  A realtime byte 'then'
+ * (0 for none) goes in the TX ring right behind the message, all or
+ * nothing, for when it must not overtake the message in the realtime
+ * lane.  Realtime bytes queued after it are held until it went out, a
+ * clock must not overtake it either.
+ */
+static int serial_midi_tx_then(struct serial_midi_port *p, uint8_t status,
+			       uint8_t d1, uint8_t d2, uint8_t len,
+			       bool refresh, uint8_t then)
+{
+	const uint32_t needed = len + 1 + (then != 0);
+	k_spinlock_key_t key;
+
+	if (p == NULL || !p->ready) {
+		return -ENODEV;
+	}
+	if (status >= RT_TIMING_CLOCK) {
+		return serial_midi_tx_realtime(p, status);
+	}
+
+	for (;;) {
+		key = k_spin_lock(&p->tx_lock);
+
+		if (serial_midi_coalesce_flush_channel(p, status) &&
+		    (then == 0 ||
+		     ring_buf_space_get(&p->tx_ringbuf) >= needed) &&
+		    serial_midi_tx_put(p, status, d1, d2, len, refresh)) {
+			if (then != 0) {
+				/* Realtime, the running status stays */
+				ring_buf_put(&p->tx_ringbuf, &then, 1);
+				if (p->tx_rt_hold == 0) {
+					p->tx_rt_hold_at = p->tx_rt_in;
+				}
+				p->tx_rt_hold =
+					ring_buf_size_get(&p->tx_ringbuf);
+			}
+			break;
+		}
+
+		if (p->tx_policy == SERIAL_MIDI_TX_DROP_OLDEST &&
+		    serial_midi_tx_drop_oldest(p, needed)) {
+			/* Made room for the message including status */
+			k_spin_unlock(&p->tx_lock, key);
+			continue;
+		}
+		if (p->tx_policy == SERIAL_MIDI_TX_BLOCK && !k_is_in_isr()) {
+			k_spin_unlock(&p->tx_lock, key);
+			k_sem_take(&p->tx_space_sem, K_FOREVER);
+			continue;
+		}
+		p->stats.tx_dropped++;
+		k_spin_unlock(&p->tx_lock, key);
+		return -ENOBUFS;
+	}
+	k_spin_unlock(&p->tx_lock, key);
+
+	return 0;
+}
+
+static int serial_midi_tx(struct serial_midi_port *p, uint8_t status,
+			  uint8_t d1, uint8_t d2, uint8_t len,
+			  bool refresh)
+{
+	return serial_midi_tx_then(p, status, d1, d2, len, refresh, 0);
+}
+
+/*
+ * Move pending coalesced messages into the TX ring, oldest first, as
+ * long as the ring is below the coalescing threshold.  Caller holds
+ * p->tx_lock.
+ */
+static void serial_midi_coalesce_flush(struct serial_midi_port *p)
+{
+	uint8_t done = 0;
+
+	while (done < p->coalesce_count &&
+	       ring_buf_size_get(&p->tx_ringbuf) <
+	       MIDI1_SERIAL_COALESCE_THRESHOLD) {
+		const struct serial_midi_coalesce_slot *slot =
+		    &p->coalesce[done];
+
+		if (!serial_midi_tx_put(p, slot->status, slot->d1, slot->d2,
+					slot->len, slot->refresh)) {
+			break;
+		}
+		done++;
+	}
+	if (done == 0) {
+		return;
+	}
+	p->coalesce_count -= done;
+	memmove(&p->coalesce[0], &p->coalesce[done],
+		p->coalesce_count * sizeof(p->coalesce[0]));
+}
+
+/*
+ * Controllers that are never coalesced, their order against the other
+ * messages of the channel matters: bank select before the program
+ * change it selects, the pedals against the notes, RPN/NRPN numbers
+ * with the data entry that goes with them, and the channel mode
+ * messages.
+ */
+static bool serial_midi_cc_coalesces(uint8_t controller)
+{
+	switch (controller) {
+	case CTL_MSB_BANK:
+	case CTL_LSB_BANK:
+	case CTL_MSB_DATA_ENTRY:
+	case CTL_LSB_DATA_ENTRY:
+		return false;
+	default:
+		break;
+	}
+	if (controller >= CTL_SUSTAIN && controller <= CTL_HOLD2) {
+		return false;
+	}
+	if (controller >= CTL_DATA_INCREMENT && controller <= CTL_RPN_MSB) {
+		return false;
+	}
+	return controller < CTL_ALL_SOUNDS_OFF;
+}
+
+/*
+ * Controller style messages: while the link is busy only the latest
+ * value per channel and controller (per channel for pitch wheel and
+ * aftertouch) is kept.  'key' is the controller number, or 0 for
+ * messages that have one value per channel.  Once one message waits
+ * every following one does too, so the order between different
+ * controllers is kept.  Any other message of the channel first flushes
+ * the parked ones, see serial_midi_tx().  When all slots are taken the
+ * message is queued normally.
+ */
+static int serial_midi_tx_coalesce(struct serial_midi_port *p,
+				   uint8_t status, uint8_t key, uint8_t d1,
+				   uint8_t d2, uint8_t len, bool refresh)
+{
+	struct serial_midi_coalesce_slot *slot;
+	k_spinlock_key_t lock;
+
+	if (p == NULL || !p->ready) {
+		return -ENODEV;
+	}
+
+	lock = k_spin_lock(&p->tx_lock);
+	if (p->coalesce_count == 0 &&
+	    ring_buf_size_get(&p->tx_ringbuf) < MIDI1_SERIAL_COALESCE_THRESHOLD) {
+		/* Link keeps up, nothing to coalesce */
+		k_spin_unlock(&p->tx_lock, lock);
+		return serial_midi_tx(p, status, d1, d2, len, refresh);
+	}
+
+	for (uint8_t i = 0; i < p->coalesce_count; i++) {
+		slot = &p->coalesce[i];
+		if (slot->status == status && slot->key == key) {
+			/* Newer value replaces the one that was not sent yet */
+			slot->d1 = d1;
+			slot->d2 = d2;
+			slot->refresh |= refresh;
+			p->stats.tx_coalesced++;
+			k_spin_unlock(&p->tx_lock, lock);
+			return 0;
+		}
+	}
+	if (p->coalesce_count < MIDI1_SERIAL_COALESCE_SLOTS) {
+		slot = &p->coalesce[p->coalesce_count++];
+		slot->status = status;
+		slot->key = key;
+		slot->d1 = d1;
+		slot->d2 = d2;
+		slot->len = len;
+		slot->refresh = refresh;
+		/* The TX interrupt flushes the slots */
+		uart_irq_tx_enable(p->dev);
+		k_spin_unlock(&p->tx_lock, lock);
+		return 0;
+	}
+	k_spin_unlock(&p->tx_lock, lock);
+
+	return serial_midi_tx(p, status, d1, d2, len, refresh);
+}
+
+/* 
+ * All functions related to sending MIDI messages to the serial USART
+ */
+void SerialMidiNoteON(uint8_t port, uint8_t channel, uint8_t key,
+		      uint8_t velocity)
+{
+	serial_midi_tx(serial_midi_port_get(port), C_NOTE_ON | channel,
+		       key, velocity, 2, false);
+}
+
+static int serial_midi_note_off(struct serial_midi_port *p, uint8_t channel,
+				uint8_t key, uint8_t velocity)
+{
+	/* Sent as note on when the port asks for it, see serial_midi_tx_put() */
+	return serial_midi_tx(p, C_NOTE_OFF | channel, key, velocity, 2, false);
+}
+
+void SerialMidiNoteOFF(uint8_t port, uint8_t channel, uint8_t key,
+		       uint8_t velocity)
+{
+	serial_midi_note_off(serial_midi_port_get(port), channel, key,
+			     velocity);
+}
+
+static int serial_midi_control_change(struct serial_midi_port *p,
+				      uint8_t channel, uint8_t controller,
+				      uint8_t val)
+{
+	if (p == NULL) {
+		return -ENODEV;
+	}
+
 	/* 
 	 * Even though we keep running status on TX we retransmit every 16'th time 
-	 * to make sure the receiver is in sync even when some messages are lost. 
+	 * to make sure the receiver is in sync even when some messages are lost,
+	 * serial_midi_tx_put() counts under the TX lock.  We always send out
+	 * controller and value.
 	 */
-	if (global_running_status_tx_count >= 16) {
-		global_running_status_tx_count = 0;
-		uart_poll_out(midi, C_CONTROL_CHANGE | channel);
-		global_running_status_tx = C_CONTROL_CHANGE | channel;
-	}
-	/* If we don't have running status send out the status byte. */
-	else if ((C_CONTROL_CHANGE | channel) != global_running_status_tx) {
-		uart_poll_out(midi, C_CONTROL_CHANGE | channel);
-		global_running_status_tx = C_CONTROL_CHANGE | channel;
-		global_running_status_tx_count = 0;
+	if (serial_midi_cc_coalesces(controller)) {
+		return serial_midi_tx_coalesce(p, C_CONTROL_CHANGE | channel,
+					       controller, controller, val, 2,
+					       true);
 	}
-	/* We always send out controller and value */
-	uart_poll_out(midi, controller);
-	uart_poll_out(midi, val);
-	global_running_status_tx_count++;
+	return serial_midi_tx(p, C_CONTROL_CHANGE | channel, controller, val,
+			      2, true);
 }
 
-void SerialMidiChannelAfterTouch(uint8_t channel, uint8_t val)
+void SerialMidiControlChange(uint8_t port, uint8_t channel,
+			     uint8_t controller, uint8_t val)
 {
-	if ((C_CHANNEL_AFTERTOUCH | channel) != global_running_status_tx) {
-		uart_poll_out(midi, C_CHANNEL_AFTERTOUCH | channel);
-		global_running_status_tx = C_CHANNEL_AFTERTOUCH | channel;
-	}
-	uart_poll_out(midi, val);
+	serial_midi_control_change(serial_midi_port_get(port), channel,
+				   controller, val);
+}
+
+void SerialMidiChannelAfterTouch(uint8_t port, uint8_t channel, uint8_t val)
+{
+	serial_midi_tx_coalesce(serial_midi_port_get(port),
+				C_CHANNEL_AFTERTOUCH | channel, 0, val, 0, 1,
+				false);
 }
 
 /**
  * Modulation Wheel both LSB and MSB
  * range: 0 --> 16383
  */
-void SerialMidiModWheel(uint8_t channel, uint16_t val)
+void SerialMidiModWheel(uint8_t port, uint8_t channel, uint16_t val)
 {
-	SerialMidiControlChange(channel, CTL_MSB_MODWHEEL,
+	SerialMidiControlChange(port, channel, CTL_MSB_MODWHEEL,
 				~(CHANNEL_VOICE_MASK) & (val >> 7));
-	SerialMidiControlChange(channel, CTL_LSB_MODWHEEL,
+	SerialMidiControlChange(port, channel, CTL_LSB_MODWHEEL,
 				~(CHANNEL_VOICE_MASK) & val);
 }
 
@@ -180,226 +957,589 @@ void SerialMidiModWheel(uint8_t channel, uint16_t val)
  *       LOW   MIDDLE   HIGH
  * range: 0 --> 8192  --> 16383
  */
-void SerialMidiPitchWheel(uint8_t channel, uint16_t val)
+void SerialMidiPitchWheel(uint8_t port, uint8_t channel, uint16_t val)
 {
-	if (global_running_status_tx != (C_PITCH_WHEEL | channel)) {
-		uart_poll_out(midi, C_PITCH_WHEEL | channel);
-		global_running_status_tx = C_PITCH_WHEEL | channel;
-	}
 	// Value is 14 bits so need to shift 7
-	uart_poll_out(midi, val & ~(CHANNEL_VOICE_MASK));	// LSB
-	uart_poll_out(midi, (val >> 7) & ~(CHANNEL_VOICE_MASK));	// MSB
+	serial_midi_tx_coalesce(serial_midi_port_get(port),
+				C_PITCH_WHEEL | channel, 0,
+				val & ~(CHANNEL_VOICE_MASK),		// LSB
+				(val >> 7) & ~(CHANNEL_VOICE_MASK),	// MSB
+				2, false);
+}
+
+/* Song position pointer, in sixteenth notes since the start */
+void SerialMidiSongPosition(uint8_t port, uint16_t sixteenths)
+{
+	serial_midi_tx(serial_midi_port_get(port), SYSTEM_SONG_POSITION,
+		       sixteenths & MIDI_DATA,			// LSB
+		       (sixteenths >> 7) & MIDI_DATA,		// MSB
+		       2, false);
+}
+
+/*
+ * Continue from a song position.  Continue goes in the TX ring behind
+ * the position: through the realtime lane it would go out first and the
+ * receiver would continue from where it was.
+ */
+int SerialMidiSongPositionContinue(uint8_t port, uint16_t sixteenths)
+{
+	return serial_midi_tx_then(serial_midi_port_get(port),
+				   SYSTEM_SONG_POSITION,
+				   sixteenths & MIDI_DATA,		// LSB
+				   (sixteenths >> 7) & MIDI_DATA,	// MSB
+				   2, false, RT_CONTINUE);
+}
+
+void SerialMidiSongSelect(uint8_t port, uint8_t song)
+{
+	serial_midi_tx(serial_midi_port_get(port), SYSTEM_SONG_SELECT,
+		       song & MIDI_DATA, 0, 1, false);
 }
 
-void SerialMidiTimingClock(void)
+void SerialMidiTimingClock(uint8_t port)
 {
-	uart_poll_out(midi, RT_TIMING_CLOCK);
+	serial_midi_tx(serial_midi_port_get(port), RT_TIMING_CLOCK, 0, 0, 0,
+		       false);
 }
 
-void SerialMidiStart(void)
+void SerialMidiStart(uint8_t port)
 {
-	uart_poll_out(midi, RT_START);
+	serial_midi_tx(serial_midi_port_get(port), RT_START, 0, 0, 0,
+		       false);
 }
 
-void SerialMidiContinue(void)
+void SerialMidiContinue(uint8_t port)
 {
-	uart_poll_out(midi, RT_CONTINUE);
+	serial_midi_tx(serial_midi_port_get(port), RT_CONTINUE, 0, 0, 0,
+		       false);
 }
 
-void SerialMidiStop(void)
+void SerialMidiStop(uint8_t port)
 {
-	uart_poll_out(midi, RT_STOP);
+	serial_midi_tx(serial_midi_port_get(port), RT_STOP, 0, 0, 0,
+		       false);
 }
 
-void SerialMidiActive_Sensing(void)
+void SerialMidiActive_Sensing(uint8_t port)
 {
-	uart_poll_out(midi, RT_ACTIVE_SENSING);
+	serial_midi_tx(serial_midi_port_get(port), RT_ACTIVE_SENSING, 0, 0, 0,
+		       false);
 }
 
-void SerialMidiReset(void)
+void SerialMidiReset(uint8_t port)
 {
-	uart_poll_out(midi, RT_RESET);
+	serial_midi_tx(serial_midi_port_get(port), RT_RESET, 0, 0, 0,
+		       false);
+}
+
+/*
+ * TX part of the ISR: hand the next byte to the UART, a waiting realtime
+ * byte first.  Only one byte is given per interrupt so a realtime byte
+ * never has more than the byte on the wire ahead of it (320 us at 31250
+ * baud), filling the hardware FIFO would put the whole FIFO ahead of it.
+ * When both queues are empty the TX interrupt is switched off again
+ * until the next serial_midi_tx().
+ */
+/*
+ * A byte of tx_ringbuf just went into the UART.  When it is the first
+ * byte of a stamped message the time it waited goes into the delay
+ * histogram.  Stamps of messages DROP_OLDEST threw away are skipped.
+ * Caller holds p->tx_lock.
+ */
+static void serial_isr_tx_delay(struct serial_midi_port *p)
+{
+	while (p->tx_stamp_out != p->tx_stamp_in) {
+		uint32_t idx = p->tx_stamp_out & (MIDI1_SERIAL_TX_DELAY_STAMPS - 1);
+		int32_t ahead = (int32_t)(p->tx_stamp[idx].seq - p->tx_seq_out);
+
+		if (ahead > 0) {
+			break;
+		}
+		p->tx_stamp_out++;
+		if (ahead == 0) {
+			uint32_t us = k_cyc_to_us_floor32(k_cycle_get_32() -
+							  p->tx_stamp[idx].cycles);
+
+			p->tx_delay_hist[MIN(us / (MIDI1_SERIAL_TX_DELAY_BUCKET_BYTES *
+						   MIDI1_SERIAL_US_PER_BYTE),
+					     SERIAL_MIDI_TX_DELAY_BUCKETS - 1)]++;
+			break;
+		}
+	}
+	p->tx_seq_out++;
+}
+
+static void serial_isr_tx(struct serial_midi_port *p)
+{
+	const struct device *dev = p->dev;
+	uint8_t *data;
+	int sent;
+	k_spinlock_key_t key = k_spin_lock(&p->tx_lock);
+
+	/* Only what was queued before a held Continue may go first */
+	if (p->tx_rt_out != p->tx_rt_in &&
+	    (p->tx_rt_hold == 0 || p->tx_rt_out != p->tx_rt_hold_at)) {
+		uint32_t idx = p->tx_rt_out & (MIDI1_SERIAL_TX_RT_QUEUE_SIZE - 1);
+
+		if (uart_fifo_fill(dev, &p->tx_rt[idx], 1) == 1) {
+#if MIDI1_SERIAL_TX_RT_MEASURE
+			uint32_t delay = k_cycle_get_32() - p->tx_rt_cycles[idx];
+
+			p->stats.tx_rt_delay_sum += delay;
+			if (delay > p->stats.tx_rt_delay_max) {
+				p->stats.tx_rt_delay_max = delay;
+			}
+#endif
+#if MIDI1_SERIAL_TX_TAP
+			if (p->tx_tap) {
+				p->tx_tap(p->index, p->tx_rt[idx]);
+			}
+#endif
+			p->tx_rt_out++;
+			p->stats.tx_rt_bytes++;
+			p->stats.tx_bytes++;
+		}
+		k_spin_unlock(&p->tx_lock, key);
+		return;
+	}
+
+	serial_midi_coalesce_flush(p);
+	if (ring_buf_get_claim(&p->tx_ringbuf, &data, 1) == 0) {
+		uart_irq_tx_disable(dev);
+		k_spin_unlock(&p->tx_lock, key);
+		return;
+	}
+	sent = uart_fifo_fill(dev, data, 1);
+	if (sent > 0) {
+#if MIDI1_SERIAL_TX_TAP
+		if (p->tx_tap) {
+			p->tx_tap(p->index, *data);
+		}
+#endif
+		serial_isr_tx_delay(p);
+		p->stats.tx_bytes += sent;
+		if (p->tx_rt_hold != 0) {
+			p->tx_rt_hold--;
+		}
+	} else {
+		sent = 0;
+	}
+	ring_buf_get_finish(&p->tx_ringbuf, sent);
+	k_spin_unlock(&p->tx_lock, key);
+
+	/* Wake up a sender waiting for room */
+	k_sem_give(&p->tx_space_sem);
+}
+
+/*
+ * Take the realtime bytes (0xF8..0xFF) out of a span that was just read
+ * and hand them to the hook or the realtime queue, the other bytes are
+ * moved up to close the gaps.  The counter is read once per span, at
+ * the first realtime byte.  Returns the number of bytes left in the span.
+ */
+static int serial_isr_rx_realtime(struct serial_midi_port *p,
+				  uint8_t *data, int len)
+{
+	uint32_t now = 0;
+	bool have_now = false;
+	bool queued = false;
+	int out = 0;
+
+	for (int i = 0; i < len; i++) {
+		uint8_t c = data[i];
+
+		if (c < RT_TIMING_CLOCK) {
+			data[out++] = c;
+			continue;
+		}
+		if (!have_now) {
+			now = midi1_clock_meas_cntr_now();
+			have_now = true;
+		}
+		if (p->realtime_hook) {
+			p->realtime_hook(c, now);
+		} else if (p->rt_in - p->rt_out < MIDI1_SERIAL_RT_QUEUE_SIZE) {
+			uint32_t idx = p->rt_in & (MIDI1_SERIAL_RT_QUEUE_SIZE - 1);
+
+			p->rt_queue[idx].timestamp = now;
+			p->rt_queue[idx].msg = c;
+			p->rt_in++;
+			queued = true;
+		} else {
+			p->stats.rt_dropped++;
+		}
+	}
+	if (queued) {
+		k_sem_give(&midi_rx_sem);
+	}
+	return out;
+}
+
+/*
+ * RX part of the ISR: read the UART FIFO straight into contiguous spans
+ * claimed from the ring buffer.  When the ring is full the remaining
+ * bytes are still read (to clear the interrupt) and counted as overflow.
+ * Realtime bytes never take room in the ring.
+ */
+static void serial_isr_rx(struct serial_midi_port *p)
+{
+	const struct device *dev = p->dev;
+	uint8_t *data;
+	uint32_t len;
+	uint8_t c;
+	int rd;
+	int kept;
+	bool received = false;
+
+	for (;;) {
+		len = ring_buf_put_claim(&p->rx_ringbuf, &data,
+					 MIDI1_SERIAL_RX_QUEUE_SIZE);
+		if (len == 0) {
+			while (uart_fifo_read(dev, &c, 1) == 1) {
+				p->stats.rx_overflow++;
+			}
+			break;
+		}
+		rd = uart_fifo_read(dev, data, len);
+		if (rd < 0) {
+			rd = 0;
+		}
+		kept = serial_isr_rx_realtime(p, data, rd);
+		ring_buf_put_finish(&p->rx_ringbuf, kept);
+		if (kept > 0 && !received) {
+			p->rx_timestamp = midi1_clock_meas_cntr_now();
+			received = true;
+		}
+		/* Less than claimed means the UART FIFO is empty */
+		if ((uint32_t)rd < len) {
+			break;
+		}
+	}
+
+	if (received) {
+		k_sem_give(&midi_rx_sem);
+	}
 }
 
 /* 
  * MIDI Receive parser implementation - Interrupt Service Routine
- * we use a Message Queue FIFO buffer to store the incoming MIDI messages 
+ * we use a ring buffer to store the incoming MIDI bytes
  */
 void serial_isr_callback(const struct device *dev, void *user_data)
 {
-	uint8_t c;
+	struct serial_midi_port *p = user_data;
 
-	if (!uart_irq_update(midi)) {
+	if (!uart_irq_update(dev)) {
 		return;
 	}
 
-	if (!uart_irq_rx_ready(midi)) {
+	if (uart_irq_tx_ready(dev)) {
+		serial_isr_tx(p);
+	}
+
+	if (uart_irq_rx_ready(dev)) {
+		serial_isr_rx(p);
+	}
+}
+
+/* Hand the collected events to the batched listeners */
+static void serial_midi_batch_flush(struct serial_midi_port *p)
+{
+	struct serial_midi_listener *l;
+
+	if (p->batch_count == 0) {
 		return;
 	}
+	SYS_SLIST_FOR_EACH_CONTAINER(&p->listeners, l, node) {
+		if (l->batched) {
+			l->fn(p->index, p->batch, p->batch_count, l->user_data);
+		}
+	}
+	p->batch_count = 0;
+}
 
-	/* read until FIFO empty */
-	while (uart_fifo_read(midi, &c, 1) == 1) {
-		if (k_msgq_put(&midi_msgq, &c, K_NO_WAIT) != 0) {
-			/* Message queue is full, handle overflow if necessary */
+/*
+ * Deliver one event: straight to the normal listeners, into the batch
+ * for the batched ones.  The type masks are or-ed per port so an event
+ * nobody listens to costs two tests.
+ */
+static void serial_midi_emit(struct serial_midi_port *p,
+			     const struct midi1_msg *msg, uint32_t timestamp)
+{
+	const struct serial_midi_event ev = {
+		.timestamp = timestamp,
+		.type = msg->type,
+		.status = msg->status,
+		.data1 = msg->data1,
+		.data2 = msg->data2,
+		.param = msg->param,
+		.value = msg->value,
+	};
+	struct serial_midi_listener *l;
+	uint32_t bit = BIT(msg->type);
+
+	if (p->listener_types & bit) {
+		SYS_SLIST_FOR_EACH_CONTAINER(&p->listeners, l, node) {
+			if (!l->batched && (l->type_mask & bit)) {
+				l->fn(p->index, &ev, 1, l->user_data);
+			}
+		}
+	}
+	if (p->batched_types & bit) {
+		p->batch[p->batch_count++] = ev;
+		if (p->batch_count == MIDI1_SERIAL_EVENT_BATCH) {
+			serial_midi_batch_flush(p);
 		}
 	}
 }
 
-/* 
- * Improved version using the message queue 
+/* Deliver the queued realtime bytes of one port */
+static uint32_t serial_midi_drain_realtime(struct serial_midi_port *p)
+{
+	uint32_t n = 0;
+
+	while (p->rt_out != p->rt_in) {
+		uint32_t idx = p->rt_out & (MIDI1_SERIAL_RT_QUEUE_SIZE - 1);
+		const struct midi1_msg rt = {
+			.type = MIDI1_MSG_REALTIME,
+			.status = p->rt_queue[idx].msg,
+		};
+		uint32_t ts = p->rt_queue[idx].timestamp;
+
+		p->rt_out++;
+		serial_midi_emit(p, &rt, ts);
+#if MIDI1_SERIAL_TRACE
+		midi1_serial_trace_add(rt.status, p->parser.running_status,
+				       p->parser.count);
+#endif
+		n++;
+	}
+	p->stats.rx_bytes += n;
+	return n;
+}
+
+/*
+ * Parse everything in the receive ring of one port.  Realtime bytes
+ * that arrived meanwhile are delivered between the spans so a clock
+ * byte waits at most one span of channel data.
  */
-int midi_msgq_get(uint8_t *data)
+static uint32_t serial_midi_drain(struct serial_midi_port *p)
 {
-	return k_msgq_get(&midi_msgq, data, K_FOREVER);
+	uint8_t *data;
+	uint32_t len;
+	uint32_t total;
+	uint32_t start = k_cycle_get_32();
+
+	serial_midi_drain_realtime(p);
+	total = 0;
+	while ((len = ring_buf_get_claim(&p->rx_ringbuf, &data,
+					 MIDI1_SERIAL_RX_QUEUE_SIZE)) > 0) {
+#if MIDI1_SERIAL_TRACE
+		for (uint32_t i = 0; i < len; i++) {
+			midi1_parser_byte(&p->parser, data[i]);
+			midi1_serial_trace_add(data[i],
+					       p->parser.running_status,
+					       p->parser.count);
+		}
+#else
+		midi1_parser_bytes(&p->parser, data, len);
+#endif
+		ring_buf_get_finish(&p->rx_ringbuf, len);
+		total += len;
+		serial_midi_drain_realtime(p);
+	}
+	serial_midi_batch_flush(p);
+
+	if (total == 0) {
+		return 0;
+	}
+	p->stats.rx_parse_cycles += k_cycle_get_32() - start;
+	p->stats.rx_wakeups++;
+	p->stats.rx_bytes += total;
+	if (total > p->stats.rx_max_burst) {
+		p->stats.rx_max_burst = total;
+	}
+	return total;
 }
 
-/* 
- * We parse one byte at a time for the MIDI parsing. Then callback functions are called
- * for each complete message 
+/*
+ * Blocks until an ISR signals new data and then parses everything that
+ * is in the receive rings of all ports, so one wakeup handles a whole
+ * burst.  Listeners are called for each complete message.  The
+ * realtime queues of all ports go first.
  */
 void SerialMidiReceiveParser(void)
 {
-	uint8_t c;
+	if (k_sem_take(&midi_rx_sem, K_FOREVER) != 0) {
+		return;
+	}
 
-	/*  
-	 * Read only _one_ byte from the circular FIFO input buffer
-	 * This buffer is filled by the ISR routine on receipt of
-	 * data on the port.
-	 */
-	if (k_msgq_get(&midi_msgq, &c, K_FOREVER) != 0) {
+	for (uint8_t port = 0; port < SERIAL_MIDI_NUM_PORTS; port++) {
+		if (serial_midi_ports[port].ready) {
+			serial_midi_drain_realtime(&serial_midi_ports[port]);
+			serial_midi_batch_flush(&serial_midi_ports[port]);
+		}
+	}
+
+	for (uint8_t port = 0; port < SERIAL_MIDI_NUM_PORTS; port++) {
+		if (serial_midi_ports[port].ready) {
+			serial_midi_drain(&serial_midi_ports[port]);
+		}
+	}
+}
+
+/* -- System exclusive streaming -- */
+static struct serial_midi_sysex_chunk *serial_midi_sysex_alloc(void)
+{
+	void *mem;
+
+	if (k_mem_slab_alloc(&midi_sysex_slab, &mem, K_NO_WAIT) != 0) {
+		return NULL;
+	}
+	((struct serial_midi_sysex_chunk *)mem)->len = 0;
+	return mem;
+}
+
+/* Hand the current chunk to the consumer, it owns it from now on */
+static void serial_midi_sysex_deliver(struct serial_midi_port *p, uint8_t flags)
+{
+	struct serial_midi_sysex_chunk *chunk = p->sysex_chunk;
+
+	p->sysex_chunk = NULL;
+	chunk->flags = p->sysex_flags | flags;
+	p->sysex_flags = SERIAL_MIDI_SYSEX_CONTINUE;
+	p->sysex_delegate(chunk);
+}
+
+/*
+ * A status byte ends the message, normally 0xF7 but any other status
+ * (except realtime) does so too.
+ */
+static void serial_midi_sysex_end(void *ctx, bool aborted)
+{
+	struct serial_midi_port *p = ctx;
+
+	if (p->sysex_chunk == NULL) {
 		return;
+	}
+	if (!aborted) {
+		serial_midi_sysex_deliver(p, SERIAL_MIDI_SYSEX_END);
 	} else {
-		/* Valid message received */
-		printk("%2X ", c);
+		serial_midi_sysex_deliver(p, SERIAL_MIDI_SYSEX_END |
+					  SERIAL_MIDI_SYSEX_ABORTED);
 	}
+}
 
-	/* 
-	 * Future implementation option
-	 * To allow software MIDI THRU (kind of with some processing delay)
-	 * simply write what is received to the output. 
-	 * uart_poll_out(midi, c);
-	 */
+/*
+ * A full chunk is only delivered when the next data byte arrives, so
+ * the END flag always goes with the last data and never in an empty
+ * chunk.
+ */
+static void serial_midi_sysex_byte(void *ctx, uint8_t c)
+{
+	struct serial_midi_port *p = ctx;
+	struct serial_midi_sysex_chunk *next;
 
-	/* Check if bit7 = 1 */
-	if (c & CHANNEL_VOICE_MASK) {
-		/* if (! (c & SYSTEM_REALTIME_MASK)) */
-		/* is it a real-time message?  0xF8 up to 0xFF */
-		if (c >= 0xF8) {
-			realtime_handler_delegate(c);
-			return;
-		} else {
-			global_running_status_rx = c;
-			global_3rd_byte_flag = 0;
-			/* Is this a tune request */
-			if (c == SYSTEM_TUNE_REQUEST) {
-				global_midi_c2 = c;	/*  Store in FIFO. */
-				/* TODO: Process something. */
-				return;
-			}
-			/* 
-			 * Do nothing
-			 * Ignore for now 
-			 */
+	if (p->sysex_chunk == NULL) {
+		/* No consumer, or the message was already cut short */
+		return;
+	}
+	if (p->sysex_chunk->len == MIDI1_SERIAL_SYSEX_CHUNK_SIZE) {
+		next = serial_midi_sysex_alloc();
+		if (next == NULL) {
+			/* Consumer is too slow, end what we have */
+			p->stats.sysex_dropped++;
+			serial_midi_sysex_deliver(p, SERIAL_MIDI_SYSEX_END |
+						  SERIAL_MIDI_SYSEX_ABORTED);
 			return;
 		}
-	} else {		/* Bit 7 == 0   (data) */
-		if (global_3rd_byte_flag == 1) {
-			global_3rd_byte_flag = 0;
-			global_midi_c3 = c;
-
-			/* 
-			 * TODO: We don't care about the input channel (OMNI) for now. 
-			 * so what we are doing here is to set the lower 4 bits to 0.
-			 */
-			global_running_status_rx &= 0xF0;
-			if (global_running_status_rx == C_NOTE_ON) {
-				if (global_midi_c3 == 0) {
-					/* 
-					 * A lot of MIDI implementation use velocity zero "note on"
-					 * as a "note-off".  Other do use a note off and the note off velocity
-					 * actually can be used to alter the sound of the note off.
-					 */
-					midi_note_off_delegate(global_midi_c2,
-							       global_midi_c3);
-					return;
-				} else {
-					midi_note_on_delegate(global_midi_c2,
-							      global_midi_c3);
-					return;
-				}
-				return;
-			} else if (global_running_status_rx == C_NOTE_OFF) {
-				midi_note_off_delegate(global_midi_c2,
-						       global_midi_c3);
-				return;
-			} else if (global_running_status_rx == C_PITCH_WHEEL) {
-				midi_pitchwheel_delegate(global_midi_c2,
-							 global_midi_c3);
-				return;
-			} else if (global_running_status_rx == C_PROGRAM_CHANGE) {
-				return;
-			} else if (global_running_status_rx ==
-				   C_POLYPHONIC_AFTERTOUCH) {
-				return;
-			} else if (global_running_status_rx ==
-				   C_CHANNEL_AFTERTOUCH) {
-				return;
-			} else if (global_running_status_rx == C_CONTROL_CHANGE) {
-				midi_control_change_delegate(global_midi_c2,
-							     global_midi_c3);
-				return;
-			} else {
-				/* Ignore */
-				return;
-			}
-		} else {
-			if (global_running_status_rx == 0) {
-				/* Ignore data Byte if running status is  0 */
-				return;
-			} else {
-				if (global_running_status_rx < 0xC0) {	/* All 2 byte commands */
-					global_3rd_byte_flag = 1;
-					global_midi_c2 = c;
-					// At this stage we have only 1 byte out of 2.
-					return;
-				} else if (global_running_status_rx < 0xE0) {	/* All 1 byte commands */
-					global_midi_c2 = c;
-					/* TODO: !! Process callback/delegate for two bytes command. */
-					return;
-				} else if (global_running_status_rx < 0xF0) {
-					global_3rd_byte_flag = 1;
-					global_midi_c2 = c;
-				}
-				/* !! */
-				else if (global_running_status_rx >= 0xF0) {
-					if (global_running_status_rx == 0xF2) {
-						global_running_status_rx = 0;
-						global_3rd_byte_flag = 1;
-						global_midi_c2 = c;
-						return;
-					} else if (global_running_status_rx >=
-						   0xF0) {
-						if (global_running_status_rx ==
-						    0xF3
-						    || global_running_status_rx
-						    == 0xF3) {
-							global_running_status_rx
-							    = 0;
-							global_midi_c2 = c;
-							/*  TODO: !! Process callback for two bytes command. */
-							return;
-						} else {
-							/* Ignore status */
-							global_running_status_rx
-							    = 0;
-							return;
-						}
-					}
-				}
-			}
-		}		/*  global_3rd_byte_flag */
-	}			/* end of data bit 7 == 0 */
+		serial_midi_sysex_deliver(p, 0);
+		p->sysex_chunk = next;
+	}
+	p->sysex_chunk->data[p->sysex_chunk->len++] = c;
+}
+
+/* 0xF0 starts collecting when there is a consumer */
+static void serial_midi_sysex_start(void *ctx)
+{
+	struct serial_midi_port *p = ctx;
 
-}				/* End of SerialMidiReceiveParser */
+	if (p->sysex_delegate == NULL) {
+		return;
+	}
+	p->sysex_chunk = serial_midi_sysex_alloc();
+	if (p->sysex_chunk == NULL) {
+		p->stats.sysex_dropped++;
+		return;
+	}
+	p->sysex_flags = SERIAL_MIDI_SYSEX_START;
+}
+
+/*
+ * A complete message from the parser.  The ISR takes realtime bytes out
+ * before they reach the ring, the parser only sees them when fed by
+ * something else so they get the time of now.
+ *
+ * Controllers also go through the assembly stage, but only while
+ * someone listens to the assembled types.
+ */
+static void serial_midi_on_message(void *ctx, const struct midi1_msg *msg)
+{
+	struct serial_midi_port *p = ctx;
+	uint32_t ts = p->rx_timestamp;
+	struct midi1_msg assembled;
+
+	if (msg->type == MIDI1_MSG_REALTIME) {
+		ts = midi1_clock_meas_cntr_now();
+	}
+	serial_midi_emit(p, msg, ts);
+
+	if (msg->type == MIDI1_MSG_CONTROL_CHANGE &&
+	    ((p->listener_types | p->batched_types) &
+	     SERIAL_MIDI_EV_ASSEMBLED) &&
+	    midi1_controller_assemble(&p->controllers, msg, &assembled)) {
+		serial_midi_emit(p, &assembled, ts);
+	}
+}
+
+static const struct midi1_parser_ops serial_midi_parser_ops = {
+	.message = serial_midi_on_message,
+	.sysex_start = serial_midi_sysex_start,
+	.sysex_byte = serial_midi_sysex_byte,
+	.sysex_end = serial_midi_sysex_end,
+};
+
+/*
+ * Generic transmit, the parser table also tells how long a message to
+ * send is.
+ */
+int SerialMidiSendMessage(uint8_t port, uint8_t status, uint8_t d1,
+			  uint8_t d2)
+{
+	struct serial_midi_port *p = serial_midi_port_get(port);
+	uint8_t len = midi1_msg_len(status);
+
+	d1 &= MIDI_DATA;
+	d2 &= MIDI_DATA;
+	switch (midi1_msg_type(status)) {
+	case MIDI1_MSG_NOTE_OFF:
+		/* Follows the note off mode of the port */
+		return serial_midi_note_off(p, status & CHANNEL_MASK, d1, d2);
+	case MIDI1_MSG_CONTROL_CHANGE:
+		/* Keeps the every 16th status byte resend */
+		return serial_midi_control_change(p, status & CHANNEL_MASK,
+						  d1, d2);
+	case MIDI1_MSG_PITCH_WHEEL:
+	case MIDI1_MSG_CHANNEL_AFTERTOUCH:
+		return serial_midi_tx_coalesce(p, status, 0, d1, d2, len,
+					       false);
+	case MIDI1_MSG_DATA:
+	case MIDI1_MSG_SYSTEM_EXCLUSIVE:
+	case MIDI1_MSG_UNDEFINED:
+		return -EINVAL;
+	default:
+		return serial_midi_tx(p, status, d1, d2, len, false);
+	}
+}
 
 /* EOF */
@@ -18,39 +18,465 @@
 /*-----------------------------------------------------------------------*/
 #include <string.h>		/* Check if really needed ? */
 #include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+#include <zephyr/sys/slist.h>
+#include <zephyr/sys/util.h>
 
 /* MIDI1.0 definitions by Jan-Willem Smaal */
 #include "midi1.h"
+#include "midi1_parser.h"
 
 #define MIDI1_SERIAL_DEBUG 1
 
+/*
+ * Trace every received byte in a RAM ring (midi1_serial_trace.h) instead
+ * of printing it.  Costs one store per byte and the parser falls back
+ * to a byte at a time, so it is opt-in.  The main loop dumps the ring
+ * with its statistics, prj.conf has no shell for "midi trace" because
+ * the console shares LPUART0 with MIDI.
+ */
+#ifndef MIDI1_SERIAL_TRACE
+#define MIDI1_SERIAL_TRACE 0
+#endif
+
+/*
+ * Device tree aliases of the DIN ports, port 0 is the first one that
+ * exists.  Boards with more DIN ports add "midi1", "midi2", ... aliases.
+ */
+#ifndef SERIAL_MIDI_PORT_ALIASES
+#define SERIAL_MIDI_PORT_ALIASES midi, midi1, midi2, midi3
+#endif
+/* Upper bound for SerialMidiNumPorts(), for sizing per port arrays */
+#define SERIAL_MIDI_MAX_PORTS (NUM_VA_ARGS_LESS_1(SERIAL_MIDI_PORT_ALIASES) + 1)
+
+/*
+ * Size of the transmit queue in bytes.  The senders only copy their
+ * bytes into this queue, the UART TX interrupt drains it.  At 31250 baud
+ * one byte takes 320 us so 128 bytes is ~41 ms of traffic.
+ */
+#ifndef MIDI1_SERIAL_TX_QUEUE_SIZE
+#define MIDI1_SERIAL_TX_QUEUE_SIZE 128
+#endif
+
+/*
+ * Outgoing realtime bytes (clock, start, continue, stop, ...) skip the
+ * transmit queue and wait in a lane of this many bytes instead.  The TX
+ * interrupt sends them at the next byte boundary, also in the middle of
+ * another message as the MIDI spec allows.  Must be a power of two.
+ */
+#ifndef MIDI1_SERIAL_TX_RT_QUEUE_SIZE
+#define MIDI1_SERIAL_TX_RT_QUEUE_SIZE 8
+#endif
+
+/*
+ * Coalescing of controller style messages (control change, pitch wheel,
+ * channel aftertouch).  Once more than MIDI1_SERIAL_COALESCE_THRESHOLD
+ * bytes wait in the transmit queue these messages are parked in one of
+ * MIDI1_SERIAL_COALESCE_SLOTS slots, keyed by channel and controller, and
+ * a newer value overwrites the parked one.  The slots go out once the
+ * queue drains below the threshold, or before any other message of the
+ * same channel.  Notes and realtime are never coalesced, nor are bank
+ * select, the pedals (64..69), data entry, RPN/NRPN numbers and the
+ * channel mode messages.  32 bytes is ~10 ms at 31250 baud.
+ */
+#ifndef MIDI1_SERIAL_COALESCE_SLOTS
+#define MIDI1_SERIAL_COALESCE_SLOTS 32
+#endif
+#ifndef MIDI1_SERIAL_COALESCE_THRESHOLD
+#define MIDI1_SERIAL_COALESCE_THRESHOLD 32
+#endif
+
+/*
+ * Measure how long every outgoing realtime byte waited before it went
+ * into the UART, see tx_rt_delay_* in struct serial_midi_stats.
+ */
+#ifndef MIDI1_SERIAL_TX_RT_MEASURE
+#define MIDI1_SERIAL_TX_RT_MEASURE MIDI1_SERIAL_DEBUG
+#endif
+
+/*
+ * Call a tap with every byte handed to the UART, see
+ * SerialMidiSetTxTap().  For tests of what goes out in which order.
+ */
+#ifndef MIDI1_SERIAL_TX_TAP
+#define MIDI1_SERIAL_TX_TAP 0
+#endif
+
+/*
+ * Size of the receive ring buffer in bytes.  The parser thread drains it
+ * completely every time it wakes up.
+ */
+#ifndef MIDI1_SERIAL_RX_QUEUE_SIZE
+#define MIDI1_SERIAL_RX_QUEUE_SIZE 128
+#endif
+
+/*
+ * Realtime bytes (0xF8..0xFF) are taken out of the received data in the
+ * RX ISR and timestamped with the free running measurement counter
+ * (midi1_clock_measure_counter.h).  Unless a realtime hook handles them
+ * in the ISR they go into their own queue of this many entries, which
+ * the parser thread empties before it looks at the other bytes.  Must
+ * be a power of two.
+ */
+#ifndef MIDI1_SERIAL_RT_QUEUE_SIZE
+#define MIDI1_SERIAL_RT_QUEUE_SIZE 16
+#endif
+
+/**
+ * @brief What a sender does when the transmit queue is full.
+ *
+ * @note From ISR context a sender never blocks, BLOCK then behaves
+ * like DROP_NEWEST.
+ */
+enum serial_midi_tx_policy {
+	/* Wait until the TX interrupt made room */
+	SERIAL_MIDI_TX_BLOCK = 0,
+	/* Discard the message that does not fit */
+	SERIAL_MIDI_TX_DROP_NEWEST,
+	/*
+	 * Discard queued messages (oldest first) to make room, not past a
+	 * Continue queued behind its song position, then the new message
+	 * is discarded
+	 */
+	SERIAL_MIDI_TX_DROP_OLDEST,
+};
+
+#ifndef MIDI1_SERIAL_TX_POLICY
+#define MIDI1_SERIAL_TX_POLICY SERIAL_MIDI_TX_BLOCK
+#endif
+
+/*
+ * System exclusive messages are streamed to the consumer in chunks taken
+ * from a k_mem_slab, the message itself is never buffered completely.
+ * With 4 chunks of 60 bytes a dump of any length passes in 256 bytes of
+ * RAM as long as the consumer frees the chunks in time.
+ */
+#ifndef MIDI1_SERIAL_SYSEX_CHUNK_SIZE
+#define MIDI1_SERIAL_SYSEX_CHUNK_SIZE 60
+#endif
+#ifndef MIDI1_SERIAL_SYSEX_CHUNKS
+#define MIDI1_SERIAL_SYSEX_CHUNKS 4
+#endif
+
+/*
+ * Events handed to a batched listener at most at once, the parser thread
+ * collects them per port while it drains the receive ring.
+ */
+#ifndef MIDI1_SERIAL_EVENT_BATCH
+#define MIDI1_SERIAL_EVENT_BATCH 16
+#endif
+
+/* Flags of a system exclusive chunk */
+#define SERIAL_MIDI_SYSEX_START    0x01	/* first chunk of a message */
+#define SERIAL_MIDI_SYSEX_CONTINUE 0x02	/* a chunk in the middle */
+#define SERIAL_MIDI_SYSEX_END      0x04	/* last chunk of a message */
+#define SERIAL_MIDI_SYSEX_ABORTED  0x08	/* END without 0xF7 or data lost */
+
+/**
+ * @brief Part of a system exclusive message.
+ *
+ * @note data holds the bytes between 0xF0 and 0xF7, the framing bytes
+ * themselves are not included.  The consumer owns the chunk and must
+ * hand it back with SerialMidiSysexChunkFree().
+ */
+struct serial_midi_sysex_chunk {
+	uint16_t len;
+	uint8_t flags;
+	uint8_t reserved;
+	uint8_t data[MIDI1_SERIAL_SYSEX_CHUNK_SIZE];
+};
+
+/*
+ * Link statistics.  Utilization is an exponential moving average of the
+ * bytes per MIDI1_SERIAL_UTIL_PERIOD_MS against the 3125 bytes/s a
+ * 31250 baud link carries.  The TX queueing delay is measured: a
+ * message is stamped with k_cycle_get_32() when it is queued and the TX
+ * interrupt records how long it waited when its first byte goes into
+ * the UART.  Up to MIDI1_SERIAL_TX_DELAY_STAMPS messages are in flight
+ * with a stamp, the ones queued while all stamps are taken are not
+ * measured.  The histogram buckets are the wire time of
+ * MIDI1_SERIAL_TX_DELAY_BUCKET_BYTES bytes wide, 320 us per byte.
+ */
+#ifndef MIDI1_SERIAL_UTIL_PERIOD_MS
+#define MIDI1_SERIAL_UTIL_PERIOD_MS 250
+#endif
+#ifndef MIDI1_SERIAL_TX_DELAY_BUCKET_BYTES
+#define MIDI1_SERIAL_TX_DELAY_BUCKET_BYTES 4
+#endif
+/* Must be a power of two */
+#ifndef MIDI1_SERIAL_TX_DELAY_STAMPS
+#define MIDI1_SERIAL_TX_DELAY_STAMPS 16
+#endif
+#define MIDI1_SERIAL_BYTES_PER_SEC 3125
+#define MIDI1_SERIAL_US_PER_BYTE 320
+
+/**
+ * @brief Counters kept per port by the serial MIDI driver.
+ *
+ * @note SerialMidiGetStats() copies the counters without a lock, every
+ * field is consistent on its own but fields can be a few bytes apart.
+ */
+struct serial_midi_stats {
+	/* Messages discarded because the TX queue was full */
+	uint32_t tx_dropped;
+	/* Realtime bytes discarded because the TX realtime lane was full */
+	uint32_t tx_rt_dropped;
+	/* Bytes lost because the RX ring buffer was full */
+	uint32_t rx_overflow;
+	/* Bytes parsed, rx_bytes / rx_wakeups is the bytes per wakeup */
+	uint32_t rx_bytes;
+	/* Times the parser thread woke up to drain the RX ring */
+	uint32_t rx_wakeups;
+	/* Largest number of bytes parsed in one wakeup */
+	uint32_t rx_max_burst;
+	/* k_cycle_get_32() cycles spent parsing, divide by rx_bytes */
+	uint32_t rx_parse_cycles;
+	/* System exclusive messages cut short because no chunk was free */
+	uint32_t sysex_dropped;
+	/* Realtime bytes lost because the realtime queue was full */
+	uint32_t rt_dropped;
+	/* Realtime bytes sent through the TX realtime lane */
+	uint32_t tx_rt_bytes;
+	/*
+	 * With MIDI1_SERIAL_TX_RT_MEASURE: k_cycle_get_32() cycles between
+	 * queueing a realtime byte and handing it to the UART.  Average is
+	 * tx_rt_delay_sum / tx_rt_bytes.
+	 */
+	uint32_t tx_rt_delay_max;
+	uint32_t tx_rt_delay_sum;
+	/* Controller style messages replaced by a newer value before sending */
+	uint32_t tx_coalesced;
+	/* Bytes handed to the UART, realtime lane included */
+	uint32_t tx_bytes;
+	/* Status bytes left out thanks to running status */
+	uint32_t tx_running_status_saved;
+	/* Of those, the ones only saved because note off was sent as note on */
+	uint32_t tx_note_off_saved;
+	/* Most bytes ever waiting in the TX queue */
+	uint32_t tx_queue_high_water;
+	/*
+	 * Received bytes that did not fit: data without status, undefined
+	 * status bytes and messages cut short by a new status byte.
+	 */
+	uint32_t rx_parse_errors;
+	/* Rolling link utilization in percent, see MIDI1_SERIAL_UTIL_PERIOD_MS */
+	uint8_t tx_utilization;
+	uint8_t rx_utilization;
+	/*
+	 * Measured TX queueing delay percentiles in us, from queueing a
+	 * message to its first byte going into the UART.  Computed from the
+	 * histogram by SerialMidiGetStats(), upper edge of the bucket.
+	 */
+	uint32_t tx_delay_p50_us;
+	uint32_t tx_delay_p90_us;
+	uint32_t tx_delay_p99_us;
+};
+
+/**
+ * @brief Received message types, also the bit numbers of a type mask.
+ *
+ * The channel message types follow the order of their status nibble,
+ * 0x8n is SERIAL_MIDI_EV_NOTE_OFF ... 0xEn is SERIAL_MIDI_EV_PITCH_WHEEL.
+ * They are the message types of midi1_parser.h.
+ */
+enum serial_midi_event_type {
+	SERIAL_MIDI_EV_NOTE_OFF = MIDI1_MSG_NOTE_OFF,
+	SERIAL_MIDI_EV_NOTE_ON = MIDI1_MSG_NOTE_ON,
+	SERIAL_MIDI_EV_POLY_AFTERTOUCH = MIDI1_MSG_POLY_AFTERTOUCH,
+	SERIAL_MIDI_EV_CONTROL_CHANGE = MIDI1_MSG_CONTROL_CHANGE,
+	SERIAL_MIDI_EV_PROGRAM_CHANGE = MIDI1_MSG_PROGRAM_CHANGE,
+	SERIAL_MIDI_EV_CHANNEL_AFTERTOUCH = MIDI1_MSG_CHANNEL_AFTERTOUCH,
+	SERIAL_MIDI_EV_PITCH_WHEEL = MIDI1_MSG_PITCH_WHEEL,
+	SERIAL_MIDI_EV_SYSTEM_COMMON = MIDI1_MSG_SYSTEM_COMMON,	/* F1, F2, F3, F6 */
+	SERIAL_MIDI_EV_REALTIME = MIDI1_MSG_REALTIME,	/* F8..FF */
+	/* Assembled from control changes, see midi1_controller.h */
+	SERIAL_MIDI_EV_CC14 = MIDI1_MSG_CC14,
+	SERIAL_MIDI_EV_RPN = MIDI1_MSG_RPN,
+	SERIAL_MIDI_EV_NRPN = MIDI1_MSG_NRPN,
+	SERIAL_MIDI_EV_COUNT
+};
+
+#define SERIAL_MIDI_EV_MASK(type) BIT(type)
+/* Every message as received */
+#define SERIAL_MIDI_EV_ALL BIT_MASK(SERIAL_MIDI_EV_REALTIME + 1)
+/*
+ * The assembled types.  The assembly only runs on a port while a
+ * listener has one of them in its mask.  The control change messages
+ * are delivered too, to the listeners with SERIAL_MIDI_EV_CONTROL_CHANGE
+ * in their mask, leave it out to only get the assembled values.  A
+ * value sent as MSB and LSB gives two assembled events, see
+ * midi1_controller.h.
+ */
+#define SERIAL_MIDI_EV_ASSEMBLED (SERIAL_MIDI_EV_MASK(SERIAL_MIDI_EV_CC14) | \
+				  SERIAL_MIDI_EV_MASK(SERIAL_MIDI_EV_RPN) | \
+				  SERIAL_MIDI_EV_MASK(SERIAL_MIDI_EV_NRPN))
+
+/**
+ * @brief One received message, 12 bytes.
+ *
+ * The timestamp is the measurement counter value
+ * (midi1_clock_measure_counter.h) taken in the RX ISR, for realtime
+ * bytes at the byte itself, for other messages at the interrupt that
+ * delivered the latest received bytes.  A note on with velocity 0 has
+ * type SERIAL_MIDI_EV_NOTE_OFF but keeps its 0x9n status.  Messages with
+ * one data byte have data2 0.
+ *
+ * param and value are only set for the assembled types: controller
+ * (0..31) or parameter number and the 14 bit value.  The assembled
+ * event comes right after the control change that completed it.
+ */
+struct serial_midi_event {
+	uint32_t timestamp;
+	uint8_t type;		/* enum serial_midi_event_type */
+	uint8_t status;		/* status byte, channel in the low nibble */
+	uint8_t data1;
+	uint8_t data2;
+	uint16_t param;
+	uint16_t value;
+};
+
+static inline uint8_t serial_midi_event_channel(const struct serial_midi_event *ev)
+{
+	return ev->status & CHANNEL_MASK;
+}
+
+/*
+ * Listener callback.  A normal listener gets one event per call, a
+ * batched listener gets all events of one parser wakeup (up to
+ * MIDI1_SERIAL_EVENT_BATCH per call) including types outside its mask,
+ * so it has to check the type itself.
+ */
+typedef void (*serial_midi_listener_fn)(uint8_t port,
+					const struct serial_midi_event *events,
+					size_t count, void *user_data);
+
+struct serial_midi_listener {
+	sys_snode_t node;
+	serial_midi_listener_fn fn;
+	void *user_data;
+	uint32_t type_mask;	/* SERIAL_MIDI_EV_MASK() bits */
+	bool batched;
+};
+
 /*-----------------------------------------------------------------------*/
 /*  Function prototypes */
+
+/*
+ * Blocks until data arrives on any port, then parses all received bytes.
+ * One thread calling this in a loop serves all ports.
+ */
 void SerialMidiReceiveParser(void);
 
-/* During the SerialMidiInit the delegate callback functions need to be assigned */
-void SerialMidiInit(void (*note_on_handler_ptr)(uint8_t note, uint8_t velocity),
-		    void(*note_off_handler_ptr)(uint8_t note, uint8_t velocity),
-		    void(*control_change_handler_ptr)(uint8_t controller,
-						      uint8_t value),
-		    void(*realtime_handler_ptr)(uint8_t msg),
-		    void(*midi_pitchwheel_ptr)(uint8_t lsb, uint8_t msb));
+/* Number of DIN ports found in the device tree */
+uint8_t SerialMidiNumPorts(void);
+
+/*
+ * All functions below take the port number (0 .. SerialMidiNumPorts() - 1)
+ * as first argument.
+ *
+ * Received messages are delivered as events to listeners, see
+ * SerialMidiAddListener().
+ */
+void SerialMidiInit(uint8_t port);
+
+/*
+ * Receive channels of a port, bit n is MIDI channel n (0..15).  Channel
+ * messages on other channels are skipped by the parser before any
+ * listener is called.  The default is SERIAL_MIDI_OMNI.
+ */
+#define SERIAL_MIDI_OMNI 0xFFFF
+void SerialMidiSetChannelMask(uint8_t port, uint16_t channel_mask);
+
+/*
+ * Register a listener for the event types in its type_mask.  The
+ * listener struct is owned by the caller and must stay valid until it
+ * is removed.  Listeners are called from the parser thread in the order
+ * they were added, do not block in them.  Add listeners before the
+ * parser thread runs or from the parser thread itself.
+ */
+int SerialMidiAddListener(uint8_t port, struct serial_midi_listener *listener);
+int SerialMidiRemoveListener(uint8_t port,
+			     struct serial_midi_listener *listener);
+
+/*
+ * System exclusive consumer.  Called from the parser thread with chunks
+ * in order, a message starts with a SERIAL_MIDI_SYSEX_START chunk and
+ * ends with a SERIAL_MIDI_SYSEX_END chunk (can be the same chunk).
+ */
+void SerialMidiSetSysexHandler(uint8_t port,
+			       void (*sysex_handler_ptr)(struct serial_midi_sysex_chunk *chunk));
+void SerialMidiSysexChunkFree(struct serial_midi_sysex_chunk *chunk);
+
+/*
+ * Realtime hook, called from the UART ISR for every realtime byte with
+ * the measurement counter value at which it arrived.  Keep it short
+ * (give a semaphore, take a timestamp).  With a hook installed no
+ * SERIAL_MIDI_EV_REALTIME events are delivered for this port, pass NULL
+ * to go back to the listeners.
+ */
+void SerialMidiSetRealtimeHook(uint8_t port,
+			       void (*realtime_hook_ptr)(uint8_t msg,
+							 uint32_t timestamp));
+
+#if MIDI1_SERIAL_TX_TAP
+/*
+ * TX tap, called from the UART ISR with every byte as it goes into the
+ * UART, both lanes.  NULL removes it.
+ */
+void SerialMidiSetTxTap(uint8_t port,
+			void (*tx_tap_ptr)(uint8_t port, uint8_t c));
+#endif
+
+/* Transmit queue */
+void SerialMidiSetTxPolicy(uint8_t port, enum serial_midi_tx_policy policy);
+/*
+ * Send note off as note on with velocity 0 so chords and note streams
+ * stay in one running status.  Only for receivers that ignore the note
+ * off velocity, it is lost.  Off by default.
+ */
+void SerialMidiSetNoteOffAsNoteOn(uint8_t port, bool enable);
+void SerialMidiGetStats(uint8_t port, struct serial_midi_stats *stats);
 
 /* Channel mode messages */
-void SerialMidiNoteON(uint8_t channel, uint8_t key, uint8_t velocity);
-void SerialMidiNoteOFF(uint8_t channel, uint8_t key, uint8_t velocity);
-void SerialMidiControlChange(uint8_t channel, uint8_t controller, uint8_t val);
-void SerialMidiPitchWheel(uint8_t channel, uint16_t val);
-void SerialMidiModWheel(uint8_t channel, uint16_t val);
-void SerialMidiChannelAfterTouch(uint8_t channel, uint8_t val);
+void SerialMidiNoteON(uint8_t port, uint8_t channel, uint8_t key,
+		      uint8_t velocity);
+void SerialMidiNoteOFF(uint8_t port, uint8_t channel, uint8_t key,
+		       uint8_t velocity);
+void SerialMidiControlChange(uint8_t port, uint8_t channel,
+			     uint8_t controller, uint8_t val);
+void SerialMidiPitchWheel(uint8_t port, uint8_t channel, uint16_t val);
+void SerialMidiModWheel(uint8_t port, uint8_t channel, uint16_t val);
+void SerialMidiChannelAfterTouch(uint8_t port, uint8_t channel, uint8_t val);
 
 /* System Common messages */
-void SerialMidiTimingClock(void);
-void SerialMidiStart(void);
-void SerialMidiContinue(void);
-void SerialMidiStop(void);
-void SerialMidiActive_Sensing(void);
-void SerialMidiReset(void);
+void SerialMidiSongPosition(uint8_t port, uint16_t sixteenths);
+/*
+ * Song position followed by Continue, in this order on the wire: the
+ * Continue does not take the realtime lane, and realtime bytes queued
+ * after this call wait until the Continue went out, so no clock counts
+ * from the old position.
+ * @return 0 or the TX queue error
+ */
+int SerialMidiSongPositionContinue(uint8_t port, uint16_t sixteenths);
+void SerialMidiSongSelect(uint8_t port, uint8_t song);
+void SerialMidiTimingClock(uint8_t port);
+void SerialMidiStart(uint8_t port);
+void SerialMidiContinue(uint8_t port);
+void SerialMidiStop(uint8_t port);
+void SerialMidiActive_Sensing(uint8_t port);
+void SerialMidiReset(uint8_t port);
+
+/*
+ * Send any channel, system common or realtime message given as status
+ * and data bytes, e.g. taken out of a UMP.  The length comes from the
+ * status byte, unused data bytes are ignored.  Goes through the same
+ * running status, coalescing and realtime lane as the functions above.
+ * @return 0, -EINVAL for data or system exclusive bytes, or the TX
+ * queue error
+ */
+int SerialMidiSendMessage(uint8_t port, uint8_t status, uint8_t d1,
+			  uint8_t d2);
 
 /* Prototype for the ISR callback */
 void serial_isr_callback(const struct device *dev, void *user_data);
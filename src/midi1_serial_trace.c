@@ -0,0 +1,97 @@
+/**
+ * @file midi1_serial_trace.c
+ * @brief binary trace of the bytes seen by the serial MIDI parser
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+#include <stdint.h>
+
+#include "midi1_serial_trace.h"
+
+BUILD_ASSERT(IS_POWER_OF_TWO(MIDI1_SERIAL_TRACE_SIZE),
+	     "MIDI1_SERIAL_TRACE_SIZE must be a power of two");
+
+/* Trace buffer, index only ever increments and wraps with the mask */
+static struct midi1_serial_trace_entry trace[MIDI1_SERIAL_TRACE_SIZE];
+static uint32_t trace_index = 0;
+
+void midi1_serial_trace_add(uint8_t byte, uint8_t status, uint8_t state)
+{
+	struct midi1_serial_trace_entry *e =
+	    &trace[trace_index & (MIDI1_SERIAL_TRACE_SIZE - 1)];
+
+	e->timestamp = k_cycle_get_32();
+	e->byte = byte;
+	e->status = status;
+	e->state = state;
+	trace_index++;
+}
+
+void midi1_serial_trace_clear(void)
+{
+	trace_index = 0;
+}
+
+void midi1_serial_trace_dump(void)
+{
+	/* Take a copy of the index, the parser may keep on adding */
+	uint32_t end = trace_index;
+	uint32_t start = 0;
+
+	if (end > MIDI1_SERIAL_TRACE_SIZE) {
+		start = end - MIDI1_SERIAL_TRACE_SIZE;
+	}
+
+	printk("midi trace: %u entries, %u cycles/s\n", end - start,
+	       sys_clock_hw_cycles_per_sec());
+	for (uint32_t i = start; i < end; i++) {
+		const struct midi1_serial_trace_entry *e =
+		    &trace[i & (MIDI1_SERIAL_TRACE_SIZE - 1)];
+
+		printk("%10u %02X rs=%02X st=%u\n", e->timestamp, e->byte,
+		       e->status, e->state);
+	}
+}
+
+#if defined(CONFIG_SHELL)
+#include <zephyr/shell/shell.h>
+
+static int cmd_midi_trace(const struct shell *sh, size_t argc, char **argv)
+{
+	ARG_UNUSED(sh);
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	midi1_serial_trace_dump();
+	return 0;
+}
+
+static int cmd_midi_trace_clear(const struct shell *sh, size_t argc,
+				char **argv)
+{
+	ARG_UNUSED(sh);
+	ARG_UNUSED(argc);
+	ARG_UNUSED(argv);
+
+	midi1_serial_trace_clear();
+	return 0;
+}
+
+SHELL_STATIC_SUBCMD_SET_CREATE(midi_trace_cmds,
+	SHELL_CMD(clear, NULL, "Empty the trace", cmd_midi_trace_clear),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_STATIC_SUBCMD_SET_CREATE(midi_cmds,
+	SHELL_CMD(trace, &midi_trace_cmds, "Dump the serial MIDI RX trace",
+		  cmd_midi_trace),
+	SHELL_SUBCMD_SET_END
+);
+
+SHELL_CMD_REGISTER(midi, &midi_cmds, "MIDI1.0 commands", NULL);
+#endif
+
+/* EOF */
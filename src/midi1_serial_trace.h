@@ -0,0 +1,64 @@
+#ifndef MIDI1_SERIAL_TRACE_H
+#define MIDI1_SERIAL_TRACE_H
+/**
+ * @file midi1_serial_trace.h
+ * @brief binary trace of the bytes seen by the serial MIDI parser
+ * @note
+ * Replaces the printk("%2X ") per received byte.  On the FRDM-MCXC242
+ * the console shares LPUART0 with MIDI so every debug print competed
+ * with the MIDI traffic itself.  The parser now only stores an entry in
+ * a RAM ring, the ring is printed on demand: midi1_serial_trace_dump(),
+ * called by the statistics print of the main loop, or the "midi trace"
+ * shell command when CONFIG_SHELL is enabled.  Enabled with
+ * MIDI1_SERIAL_TRACE=1.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+
+/**
+ * @note number of entries kept, must be a power of two.  Each entry
+ * is 8 bytes.
+ */
+#ifndef MIDI1_SERIAL_TRACE_SIZE
+#define MIDI1_SERIAL_TRACE_SIZE 128
+#endif
+
+/**
+ * @brief one traced byte
+ */
+struct midi1_serial_trace_entry {
+	/* k_cycle_get_32() when the byte was parsed */
+	uint32_t timestamp;
+	/* the received byte */
+	uint8_t byte;
+	/* running status of the parser after this byte */
+	uint8_t status;
+	/* parser state after this byte (data bytes collected) */
+	uint8_t state;
+	uint8_t reserved;
+};
+
+/**
+ * @brief store one entry, overwrites the oldest when full
+ *
+ * @param byte received byte
+ * @param status running status after the byte was parsed
+ * @param state parser state after the byte was parsed
+ */
+void midi1_serial_trace_add(uint8_t byte, uint8_t status, uint8_t state);
+
+/**
+ * @brief print the trace oldest entry first with printk
+ */
+void midi1_serial_trace_dump(void);
+
+/**
+ * @brief empty the trace
+ */
+void midi1_serial_trace_clear(void);
+
+#endif
+/* EOF */
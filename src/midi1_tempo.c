@@ -0,0 +1,146 @@
+/**
+ * @file midi1_tempo.c
+ * @brief Integer tempo math, see midi1_tempo.h
+ *
+ * @note
+ * Moved out of midi1.c unchanged, it has no Zephyr dependency and is
+ * part of the host build (host/).
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#include <stdint.h>
+#include <stdio.h>
+
+#include "midi1_tempo.h"
+
+/*
+ *------------------------------------------------------------------------------
+ * MIDI tempo helpers.
+ *
+ * upscaled implementation (s)bpm given
+ * 1.00 bpm is 100
+ * 123.10 bpm is 123100 max 65535 == 655.35 bpm
+ * period returned is in microseconds as a uint32_t
+ * 0.003814755 3.814 ms --> 3814 us (655,35 bpm)
+ * 2.500000000 s/(1/24 qn) --> 2500000 us
+ * i.e. multiplied by 1000000
+ * Done so we can run it on a ARM M0+ without a FPU and the need
+ * to compile in single precision math.
+ * By Jan-Willem Smaal <usenet@gispen.org> 20251214
+ *
+ * Because microseconds is a bit too course for timing some of these
+ * calculations will be slightly off.
+ *
+ * It's better to use clock ticks.  so the spbm_to_ticks 
+ */
+
+uint32_t sbpm_to_us_interval(uint16_t sbpm)
+{
+	if (sbpm == 0) {
+		return 0u;
+	} else {
+		uint64_t numer = (uint64_t) US_PER_SECOND * 60u * BPM_SCALE;
+		//uint64_t res = (numer + (sbpm / 2u)) / (uint64_t) sbpm;
+		// Removed rounding due to double rounding  
+		uint64_t res = numer  / (uint64_t) sbpm;
+		return (uint32_t) res;
+	}
+}
+
+
+/* 
+ * Formula:
+ * ticks_per_pulse = (clock_hz * 60 * BPM_SCALE) / (24 * sbpm)
+ *
+ * BPM_SCALE = 100 (scaled BPM format)
+ * 60 / 24 = 2.5 → multiply by 5, divide by 2
+ *
+ * keep everything in 64-bit to avoid overflow.
+ */
+uint32_t sbpm_to_ticks(uint16_t sbpm, uint32_t clock_hz)
+{
+	if (sbpm == 0 || clock_hz == 0) {
+		return 0u;
+	}
+
+	
+	const uint64_t numer = (uint64_t)clock_hz * 5ULL * 100ULL;
+	const uint64_t denom = (uint64_t)sbpm * 2ULL;
+
+	/* Rounded division */
+	uint64_t ticks = (numer + (denom / 2ULL)) / denom;
+
+	return (uint32_t)ticks;
+}
+
+uint16_t us_interval_to_sbpm(uint32_t interval)
+{
+	if (interval == 0) {
+		return 0u;
+	} else {
+		uint64_t numer = (uint64_t) US_PER_SECOND * 60u * BPM_SCALE;
+		uint64_t res = (numer + (interval / 2u)) / (uint64_t) interval;
+		return (uint32_t) res;
+	}
+}
+
+uint32_t us_interval_to_24pqn(uint32_t interval)
+{
+	if (interval == 0) {
+		return 0u;
+	} else {
+		return (interval + 12u) / 24u;
+	}
+}
+
+uint32_t pqn24_to_us_interval(uint32_t pqn24)
+{
+	if (pqn24 == 0) {
+		return 0u;
+	} else {
+		return (pqn24 * 24u) + 12u;
+	}
+}
+
+uint32_t sbpm_to_24pqn(uint16_t sbpm)
+{
+	if (sbpm == 0) {
+		return 0u;
+	} else {
+		return us_interval_to_24pqn(sbpm_to_us_interval(sbpm));
+	}
+}
+
+uint16_t pqn24_to_sbpm(uint32_t pqn24)
+{
+	if (pqn24 == 0u) {
+		return 0u;
+	}
+	
+	/* pqn24 = microseconds per tick
+	 * quarter-note interval = pqn24 * 24
+	 * SBPM = (60,000,000 * 100) / quarter-note interval
+	 */
+	uint32_t qn_interval_us = pqn24 * 24u;
+	return us_interval_to_sbpm(qn_interval_us);
+}
+
+
+const char *sbpm_to_str(uint16_t sbpm)
+{
+	/* Enough for "12345.67" + null */
+	static char buf[16];
+	
+	uint32_t whole = sbpm / 100u;   /* integer BPM */
+	uint32_t frac  = sbpm % 100u;   /* fractional part */
+	
+	/* Format:  whole.frac  (e.g. 120.00) */
+	snprintf(buf, sizeof(buf), "%u.%02u", whole, frac);
+	
+	return buf;
+}
+
+/* -------------------------------------------------------------------------- */
+/* EOF */
@@ -0,0 +1,101 @@
+/**
+ * @file midi1_tempo.h
+ * @brief Integer tempo math for MIDI1.0 clocks
+ *
+ * @note
+ * The sbpm conversions that used to be in midi1.h.  No Zephyr header,
+ * the clock generator math (midi1_clock_dds.c, midi1_clock_ramp.c)
+ * builds on the host with it, see host/.  midi1.h includes it.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_TEMPO_H
+#define MIDI1_TEMPO_H
+/*-----------------------------------------------------------------------*/
+#include <stdint.h>
+
+/*
+ *------------------------------------------------------------------------------
+ * MIDI tempo helpers.
+ *
+ * upscaled implementation (s)bpm given
+ * 1.00 bpm is 100
+ * 123.10 bpm is 123100 max 65535 == 655.35 bpm
+ * period returned is in microseconds as a uint32_t
+ * 0.003814755 3.814 ms --> 3814 us (655,35 bpm)
+ * 2.500000000 s/(1/24 qn) --> 2500000 us
+ * i.e. multiplied by 1000000
+ * Done so we can run it on a ARM M0+ without a FPU and the need
+ * to compile in single precision math.
+ *
+ */
+#define BPM_SCALE      100u
+#define US_PER_SECOND  1000000u
+
+/**
+ * @brief returns the interval in microseconds (us) for a given sbpm
+ * @param  sbpm   Scaled BPM value (e.g. 12000 for 120.00 BPM)
+ * @return interval in microseconds (us)
+ */
+uint32_t sbpm_to_us_interval(uint16_t sbpm);
+
+/**
+ * @brief returns the interval in clock ticks for a given sbpm
+ * @param sbpm   Scaled BPM value (e.g. 12000 for 120.00 BPM)
+ * @param clock_hz clock speed of the current processor
+ * @return interval clock ticks
+ */
+uint32_t sbpm_to_ticks(uint16_t sbpm, uint32_t clock_hz);
+
+/**
+ * @brief Convert a measured interval in microseconds to scaled BPM (sbpm).
+ *
+ * @param interval  Interval duration in microseconds (us)
+ * @return Scaled BPM value (e.g. 12000 for 120.00 BPM)
+ */
+uint16_t us_interval_to_sbpm(uint32_t interval);
+
+/**
+ * @brief Convert a measured interval in microseconds to 24‑PPQN period units.
+ *
+ * @param interval  Interval duration in microseconds (us)
+ * @return 24‑PPQN period value corresponding to the interval
+ */
+uint32_t us_interval_to_24pqn(uint32_t interval);
+
+/**
+ * @brief Convert a 24‑PPQN period value to an interval in microseconds.
+ *
+ * @param pqn24  24‑PPQN period value
+ * @return Interval duration in microseconds (us)
+ */
+uint32_t pqn24_to_us_interval(uint32_t pqn24);
+
+/**
+ * @brief Convert scaled BPM (sbpm) to a 24‑PPQN period value.
+ *
+ * @param sbpm  Scaled BPM value (e.g. 12000 for 120.00 BPM)
+ * @return 24‑PPQN period value corresponding to the BPM
+ */
+uint32_t sbpm_to_24pqn(uint16_t sbpm);
+
+/**
+ * @brief convert pulses per quater note to scaled bpm
+ *
+ * @param 24‑PPQN period value
+ * @return pqn24 pulses per quater note in us
+ */
+uint16_t pqn24_to_sbpm(uint32_t pqn24);
+
+/**
+ * @brief  Returns static string with the BPM formattted like 123.45
+ *
+ * @param  sbpm   Scaled BPM value (e.g. 12000 for 120.00 BPM)
+ * @return Pointer to a static buffer containing the formatted string "xxx.yy"
+ */
+const char *sbpm_to_str(uint16_t sbpm);
+
+#endif /* MIDI1_TEMPO_H */
+/* EOF */
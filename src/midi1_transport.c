@@ -0,0 +1,184 @@
+/**
+ * @file midi1_transport.c
+ * @brief Transport state machine, see midi1_transport.h
+ *
+ * @note
+ * The ISR side counts clocks in a sixteenth and sixteenths, no
+ * divides.  The song position to fan-out tick conversion is done by
+ * the thread that arms Start or Continue.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#include <zephyr/kernel.h>
+
+#include "midi1.h"
+#include "midi1_clock_counter.h"
+#include "midi1_clock_fanout.h"
+#include "midi1_transport.h"
+
+static struct k_spinlock g_lock;
+static uint8_t g_state = MIDI1_TRANSPORT_STOPPED;
+/* RT_START or RT_CONTINUE while starting */
+static uint8_t g_pending;
+/* Restarted while playing, Stop goes out one clock before the Start */
+static bool g_stop_first;
+/* Song position, and the clocks played of the current sixteenth */
+static uint16_t g_sixteenths;
+static uint8_t g_clocks;
+
+/*
+ * Arm Start or Continue from the song position.  The fan-out counts for
+ * that position are worked out here, the ISR only switches to them.
+ */
+static void midi1_transport_arm(uint8_t status)
+{
+	k_spinlock_key_t key;
+
+	midi1_clock_fanout_prepare((uint32_t)g_sixteenths *
+				   MIDI1_TRANSPORT_CLOCKS_PER_16TH *
+				   MIDI1_CLOCK_CNTR_SUBDIV);
+	key = k_spin_lock(&g_lock);
+	g_pending = status;
+	g_state = MIDI1_TRANSPORT_STARTING;
+	k_spin_unlock(&g_lock, key);
+}
+
+int midi1_transport_start(void)
+{
+	k_spinlock_key_t key;
+
+	if (!midi1_clock_cntr_running()) {
+		return -EAGAIN;
+	}
+	key = k_spin_lock(&g_lock);
+	/* A receiver must not see a Start in the middle of the song */
+	if (g_state != MIDI1_TRANSPORT_STARTING) {
+		g_stop_first = g_state != MIDI1_TRANSPORT_STOPPED;
+	}
+	/* Not counted on until the Start went out */
+	g_state = MIDI1_TRANSPORT_STOPPED;
+	g_sixteenths = 0;
+	g_clocks = 0;
+	k_spin_unlock(&g_lock, key);
+
+	midi1_transport_arm(RT_START);
+	return 0;
+}
+
+int midi1_transport_continue(void)
+{
+	k_spinlock_key_t key;
+
+	if (!midi1_clock_cntr_running()) {
+		return -EAGAIN;
+	}
+	key = k_spin_lock(&g_lock);
+	switch (g_state) {
+	case MIDI1_TRANSPORT_STOPPING:
+		/* Never stopped */
+		g_state = MIDI1_TRANSPORT_RUNNING;
+		k_spin_unlock(&g_lock, key);
+		return 0;
+	case MIDI1_TRANSPORT_STOPPED:
+		/* The song position pointer has no finer unit */
+		g_clocks = 0;
+		break;
+	default:
+		k_spin_unlock(&g_lock, key);
+		return -EALREADY;
+	}
+	k_spin_unlock(&g_lock, key);
+
+	midi1_transport_arm(RT_CONTINUE);
+	return 0;
+}
+
+void midi1_transport_stop(void)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+
+	switch (g_state) {
+	case MIDI1_TRANSPORT_STARTING:
+		/* Nothing went out yet, unless the song was still playing */
+		g_state = g_stop_first ? MIDI1_TRANSPORT_STOPPING :
+					 MIDI1_TRANSPORT_STOPPED;
+		g_stop_first = false;
+		break;
+	case MIDI1_TRANSPORT_RUNNING:
+		g_state = MIDI1_TRANSPORT_STOPPING;
+		break;
+	default:
+		break;
+	}
+	k_spin_unlock(&g_lock, key);
+}
+
+int midi1_transport_set_song_position(uint16_t sixteenths)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+	int ret = 0;
+
+	if (g_state == MIDI1_TRANSPORT_STOPPED) {
+		g_sixteenths = sixteenths;
+		g_clocks = 0;
+	} else {
+		ret = -EBUSY;
+	}
+	k_spin_unlock(&g_lock, key);
+	return ret;
+}
+
+uint16_t midi1_transport_song_position(void)
+{
+	return g_sixteenths;
+}
+
+enum midi1_transport_state midi1_transport_get_state(void)
+{
+	return g_state;
+}
+
+uint8_t midi1_transport_clock(uint16_t *sixteenths)
+{
+	k_spinlock_key_t key = k_spin_lock(&g_lock);
+	uint8_t status = 0;
+
+	switch (g_state) {
+	case MIDI1_TRANSPORT_STARTING:
+		if (g_stop_first) {
+			/* Like STOPPING, the Start follows on the next clock */
+			g_stop_first = false;
+			status = RT_STOP;
+			break;
+		}
+		/*
+		 * This clock still belongs to before, the next one is the
+		 * first of the song and gets the prepared fan-out tick.
+		 */
+		status = g_pending;
+		*sixteenths = g_sixteenths;
+		g_state = MIDI1_TRANSPORT_RUNNING;
+		midi1_clock_fanout_restart(MIDI1_CLOCK_CNTR_SUBDIV);
+		break;
+	case MIDI1_TRANSPORT_RUNNING:
+		/* Played, the position moves on */
+		if (++g_clocks == MIDI1_TRANSPORT_CLOCKS_PER_16TH) {
+			g_clocks = 0;
+			g_sixteenths++;
+		}
+		break;
+	case MIDI1_TRANSPORT_STOPPING:
+		/* Goes out before this clock, which is not counted */
+		status = RT_STOP;
+		g_state = MIDI1_TRANSPORT_STOPPED;
+		break;
+	default:
+		break;
+	}
+	k_spin_unlock(&g_lock, key);
+	return status;
+}
+
+/* EOF */
@@ -0,0 +1,93 @@
+/**
+ * @file midi1_transport.h
+ * @brief Start/Stop/Continue and song position for the counter clock
+ * generator.
+ *
+ * @note
+ * The generator clock runs all the time, the transport decides what the
+ * clocks mean.  Requests from a thread are armed and carried out by the
+ * counter ISR on the next 24 PPQN clock (midi1_transport_clock()), the
+ * message goes out with the timestamp of that clock:
+ *
+ *  - Start: the clock is sent, then Start.  The next clock, exactly one
+ *    period later, is the first one of the song at position 0.
+ *  - Continue: the same but first the song position pointer is sent
+ *    and the song goes on from there.  On DIN Continue follows the
+ *    position through the TX ring, not the realtime lane.
+ *  - Stop: Stop is sent before the clock, that clock is not counted.
+ *
+ * On Start and Continue the fan-out outputs (midi1_clock_fanout.h) are
+ * moved to the song position, a 1/16 trigger or a quarter note pulse
+ * falls on the first clock of the song.  The running position is kept
+ * in sixteenth notes, the unit of the song position pointer.
+ *
+ * @author Jan-Willem Smaal <usenet@gispen.org>
+ * @date 20261016
+ * @license SPDX-License-Identifier: Apache-2.0
+ */
+#ifndef MIDI1_TRANSPORT_H
+#define MIDI1_TRANSPORT_H
+
+#include <stdint.h>
+#include <stdbool.h>
+
+/* MIDI clocks per sixteenth note, the song position pointer unit */
+#define MIDI1_TRANSPORT_CLOCKS_PER_16TH 6
+
+enum midi1_transport_state {
+	MIDI1_TRANSPORT_STOPPED = 0,
+	MIDI1_TRANSPORT_STARTING,	/* Start or Continue on the next clock */
+	MIDI1_TRANSPORT_RUNNING,
+	MIDI1_TRANSPORT_STOPPING,	/* Stop on the next clock */
+};
+
+/**
+ * @brief Start the song from the beginning, also when it runs.  A
+ * running song is stopped first: Stop goes out on the next clock and
+ * Start on the one after it.
+ *
+ * @return 0 or -EAGAIN when the generator does not run
+ */
+int midi1_transport_start(void);
+
+/**
+ * @brief Continue from the song position, rounded down to a sixteenth
+ * note.  A pending stop is cancelled.
+ *
+ * @return 0, -EALREADY when running, -EAGAIN when the generator does
+ * not run
+ */
+int midi1_transport_continue(void);
+
+/**
+ * @brief Stop on the next clock, a pending start is cancelled.
+ */
+void midi1_transport_stop(void);
+
+/**
+ * @brief Set the song position for the next Continue, e.g. from a
+ * received song position pointer.
+ *
+ * @param sixteenths sixteenth notes since the start of the song
+ * @return 0 or -EBUSY when not stopped
+ */
+int midi1_transport_set_song_position(uint16_t sixteenths);
+
+/**
+ * @brief Song position in sixteenth notes, runs while playing.
+ */
+uint16_t midi1_transport_song_position(void);
+
+enum midi1_transport_state midi1_transport_get_state(void);
+
+/**
+ * @brief One 24 PPQN clock of the generator, from the counter ISR after
+ * the fan-out tick of the clock.
+ *
+ * @param sixteenths set to the song position to send before RT_CONTINUE
+ * @return RT_START, RT_CONTINUE or RT_STOP to send with this clock, or 0
+ */
+uint8_t midi1_transport_clock(uint16_t *sixteenths);
+
+#endif /* MIDI1_TRANSPORT_H */
+/* EOF */